@@ -0,0 +1,254 @@
+#include "augment.hpp"
+#include "utils.hpp"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+// Separable gaussian blur with a zero boundary, in place
+static void gaussian_blur(std::vector<float> &field, std::vector<float> &tmp, int width, int height, const std::vector<float> &kernel)
+{
+	const int radius = static_cast<int>(kernel.size()) / 2;
+
+	for(int y = 0; y < height; ++y)
+	{
+		for(int x = 0; x < width; ++x)
+		{
+			float sum = 0.0f;
+			for(int k = std::max(-radius, -x); k <= std::min(radius, width - 1 - x); ++k)
+				sum += kernel[k + radius] * field[y * width + x + k];
+			tmp[y * width + x] = sum;
+		}
+	}
+
+	for(int y = 0; y < height; ++y)
+	{
+		for(int x = 0; x < width; ++x)
+		{
+			float sum = 0.0f;
+			for(int k = std::max(-radius, -y); k <= std::min(radius, height - 1 - y); ++k)
+				sum += kernel[k + radius] * tmp[(y + k) * width + x];
+			field[y * width + x] = sum;
+		}
+	}
+}
+
+Augmenter::Augmenter(const AugmentParams &params):
+	m_params(params)
+{
+	if(m_params.elastic_alpha > 0.0f)
+	{
+		int radius = static_cast<int>(std::ceil(3.0f * m_params.elastic_sigma));
+		float total = 0.0f;
+
+		for(int k = -radius; k <= radius; ++k)
+		{
+			float weight = std::exp(-(float)(k*k) / (2.0f * m_params.elastic_sigma * m_params.elastic_sigma));
+			m_gaussian_kernel.push_back(weight);
+			total += weight;
+		}
+
+		for(auto &weight: m_gaussian_kernel)
+			weight /= total;
+	}
+}
+
+void Augmenter::sample(const Image &src, std::mt19937 &rng, float *out) const
+{
+	const int width = static_cast<int>(src.width);
+	const int height = static_cast<int>(src.height);
+	const int stride = width + 2;
+	const int size = width * height;
+
+	// Copy of the source with a one pixel wide zero border, so that every clamped
+	// coordinate has 4 valid neighbours and sampling needs no branch
+	std::vector<float> padded(stride * (height + 2), 0.0f);
+	for(int y = 0; y < height; ++y)
+	{
+		for(int x = 0; x < width; ++x)
+			padded[(y+1) * stride + x + 1] = src.data[y * width + x] * (1.0f / 255.0f);
+	}
+
+	std::uniform_real_distribution<float> shift(-m_params.max_shift, m_params.max_shift);
+	std::uniform_real_distribution<float> rotation(-m_params.max_rotation, m_params.max_rotation);
+	std::uniform_real_distribution<float> scale(m_params.min_scale, m_params.max_scale);
+
+	const float angle = rotation(rng);
+	const float factor = scale(rng);
+	const float shift_x = shift(rng);
+	const float shift_y = shift(rng);
+
+	// Inverse transformation: each output pixel fetches its value from the source
+	const float a = std::cos(angle) / factor;
+	const float b = std::sin(angle) / factor;
+	const float center_x = 0.5f * (width - 1);
+	const float center_y = 0.5f * (height - 1);
+
+	std::vector<float> xs(size), ys(size);
+	for(int y = 0; y < height; ++y)
+	{
+		const float dy = y - center_y - shift_y;
+		float *row_x = xs.data() + y * width;
+		float *row_y = ys.data() + y * width;
+
+		for(int x = 0; x < width; ++x)
+		{
+			const float dx = x - center_x - shift_x;
+			row_x[x] = a * dx + b * dy + center_x;
+			row_y[x] = a * dy - b * dx + center_y;
+		}
+	}
+
+	if(m_params.elastic_alpha > 0.0f)
+	{
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::vector<float> field_x(size), field_y(size), tmp(size);
+
+		for(int i = 0; i < size; ++i)
+		{
+			field_x[i] = unit(rng);
+			field_y[i] = unit(rng);
+		}
+
+		gaussian_blur(field_x, tmp, width, height, m_gaussian_kernel);
+		gaussian_blur(field_y, tmp, width, height, m_gaussian_kernel);
+
+		for(int i = 0; i < size; ++i)
+		{
+			xs[i] += m_params.elastic_alpha * field_x[i];
+			ys[i] += m_params.elastic_alpha * field_y[i];
+		}
+	}
+
+	// Bilinear sampling, written as straight branchless loops so that the compiler can vectorize
+	// the coordinate arithmetic and the blend around the 4 gathers
+	const float max_x = static_cast<float>(width);
+	const float max_y = static_cast<float>(height);
+	for(int i = 0; i < size; ++i)
+	{
+		const float fx = std::min(std::max(xs[i], -1.0f), max_x) + 1.0f;
+		const float fy = std::min(std::max(ys[i], -1.0f), max_y) + 1.0f;
+		const int x0 = std::min(static_cast<int>(fx), width);
+		const int y0 = std::min(static_cast<int>(fy), height);
+		const float tx = fx - x0;
+		const float ty = fy - y0;
+
+		const float *p = padded.data() + y0 * stride + x0;
+		const float top = p[0] + tx * (p[1] - p[0]);
+		const float bottom = p[stride] + tx * (p[stride + 1] - p[stride]);
+		out[i] = top + ty * (bottom - top);
+	}
+}
+
+void Augmenter::apply(const Image &src, std::mt19937 &rng, double *out) const
+{
+	std::vector<float> sampled(src.width * src.height);
+	sample(src, rng, sampled.data());
+
+	for(size_t i = 0; i < sampled.size(); ++i)
+		out[i] = sampled[i];
+}
+
+Image Augmenter::apply(const Image &src, std::mt19937 &rng) const
+{
+	std::vector<float> sampled(src.width * src.height);
+	sample(src, rng, sampled.data());
+
+	std::vector<uint8_t> data(sampled.size());
+	for(size_t i = 0; i < sampled.size(); ++i)
+		data[i] = static_cast<uint8_t>(std::lround(std::min(std::max(sampled[i], 0.0f), 1.0f) * 255.0f));
+
+	return Image(data, src.width, src.height);
+}
+
+AugmentedBatchLoader::AugmentedBatchLoader(
+	const std::vector<Image> &images,
+	const std::vector<uint32_t> &labels,
+	const AugmentParams &params,
+	size_t batch_size,
+	unsigned thread_count,
+	size_t prefetch,
+	uint32_t seed,
+	size_t first_batch
+):
+	m_images(images),
+	m_labels(labels),
+	m_augmenter(params),
+	m_permutation(generate_permutation(images.size())),
+	m_batch_size(batch_size),
+	m_prefetch(std::max<size_t>(prefetch, 1)),
+	m_seed(seed),
+	m_next_batch(first_batch)
+{
+	if(images.empty() || images.size() != labels.size() || batch_size == 0)
+		throw std::runtime_error("Cannot draw batches of " + std::to_string(batch_size) + " from " + std::to_string(images.size()) + " images and " + std::to_string(labels.size()) + " labels");
+
+	thread_count = std::max(thread_count, 1u);
+	for(unsigned i = 0; i < thread_count; ++i)
+	{
+		m_threads.emplace_back(&AugmentedBatchLoader::worker, this, first_batch + i, thread_count);
+	}
+}
+
+AugmentedBatchLoader::~AugmentedBatchLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+
+	for(auto &thread: m_threads)
+		thread.join();
+}
+
+Batch AugmentedBatchLoader::next()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv.wait(lock, [this]{ return m_ready.count(m_next_batch) != 0; });
+
+	auto node = m_ready.extract(m_next_batch);
+	++m_next_batch;
+
+	lock.unlock();
+	m_cv.notify_all();
+
+	return std::move(node.mapped());
+}
+
+void AugmentedBatchLoader::worker(size_t first_batch, size_t stride)
+{
+	for(size_t batch_id = first_batch;; batch_id += stride)
+	{
+		{
+			// Don't run more than m_prefetch batches ahead of the consumer
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [&]{ return m_stop || batch_id < m_next_batch + m_prefetch; });
+
+			if(m_stop)
+				return;
+		}
+
+		std::seed_seq seed {m_seed, static_cast<uint32_t>(batch_id)};
+		std::mt19937 rng(seed);
+
+		Batch batch;
+		batch.inputs.reserve(m_batch_size);
+		batch.labels.reserve(m_batch_size);
+
+		for(size_t i = 0; i < m_batch_size; ++i)
+		{
+			size_t index = m_permutation[(batch_id * m_batch_size + i) % m_permutation.size()];
+			const Image &image = m_images[index];
+
+			batch.inputs.emplace_back(image.width * image.height);
+			m_augmenter.apply(image, rng, batch.inputs.back().data());
+			batch.labels.push_back(m_labels[index]);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_ready.emplace(batch_id, std::move(batch));
+		}
+		m_cv.notify_all();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "img_data.hpp"
+
+#include <vector>
+#include <map>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+/**
+ * @brief Ranges of the random transformations applied by an Augmenter
+ *
+ */
+struct AugmentParams
+{
+	// Maximum translation along each axis, in pixels
+	float max_shift = 2.0f;
+
+	// Maximum rotation around the image center, in radians
+	float max_rotation = 0.15f;
+
+	// The scale factor is drawn uniformly in [min_scale, max_scale]
+	float min_scale = 0.9f;
+	float max_scale = 1.1f;
+
+	// Scaling of the smoothed random displacement field (Simard et al. use 34 with a sigma of 4), 0 disables it
+	float elastic_alpha = 0.0f;
+
+	// Standard deviation of the gaussian smoothing the elastic displacement field
+	float elastic_sigma = 4.0f;
+};
+
+/**
+ * @brief Applies random affine and elastic distortions to images, sampled bilinearly
+ *
+ */
+class Augmenter
+{
+public:
+	Augmenter(const AugmentParams &params = AugmentParams());
+
+	/**
+	 * @brief Writes a randomly distorted copy of src, converted to [0, 1] like Image::convert_to_01_vector
+	 *
+	 * @param src
+	 * @param rng
+	 * @param out Must hold src.width*src.height elements
+	 */
+	void apply(const Image &src, std::mt19937 &rng, double *out) const;
+
+	/**
+	 * @brief Returns a randomly distorted copy of src
+	 *
+	 * @param src
+	 * @param rng
+	 * @return Image
+	 */
+	Image apply(const Image &src, std::mt19937 &rng) const;
+
+private:
+	void sample(const Image &src, std::mt19937 &rng, float *out) const;
+
+	AugmentParams m_params;
+	std::vector<float> m_gaussian_kernel;
+};
+
+/**
+ * @brief A batch of inputs converted to [0, 1] together with their labels
+ *
+ */
+struct Batch
+{
+	std::vector<std::vector<double>> inputs;
+	std::vector<uint32_t> labels;
+};
+
+/**
+ * @brief Gathers and augments batches on background threads, a few batches ahead of the consumer.
+ * Batches are drawn from generate_permutation and returned in order, each batch being seeded by its
+ * index, so the stream does not depend on the number of threads
+ *
+ */
+class AugmentedBatchLoader
+{
+public:
+	/**
+	 * @brief Starts the loader threads, throws if there is no image, if the label count differs or if batch_size is 0
+	 *
+	 * @param images Must outlive the loader
+	 * @param labels Must outlive the loader
+	 * @param params
+	 * @param batch_size
+	 * @param thread_count
+	 * @param prefetch Number of batches that can be ready before the consumer calls next()
+	 * @param seed
+	 * @param first_batch Index of the first batch returned by next(), ex: to resume a training at the same point of the stream
+	 */
+	AugmentedBatchLoader(
+		const std::vector<Image> &images,
+		const std::vector<uint32_t> &labels,
+		const AugmentParams &params,
+		size_t batch_size,
+		unsigned thread_count = 2,
+		size_t prefetch = 4,
+		uint32_t seed = 0,
+		size_t first_batch = 0
+	);
+
+	~AugmentedBatchLoader();
+
+	AugmentedBatchLoader(const AugmentedBatchLoader&) = delete;
+	AugmentedBatchLoader &operator=(const AugmentedBatchLoader&) = delete;
+
+	/**
+	 * @brief Blocks until the next batch is ready and returns it
+	 *
+	 * @return Batch
+	 */
+	Batch next();
+
+private:
+	void worker(size_t first_batch, size_t stride);
+
+	const std::vector<Image> &m_images;
+	const std::vector<uint32_t> &m_labels;
+	Augmenter m_augmenter;
+	std::vector<uint32_t> m_permutation;
+	size_t m_batch_size;
+	size_t m_prefetch;
+	uint32_t m_seed;
+
+	// Finished batches, indexed by their position in the stream
+	std::map<size_t, Batch> m_ready;
+	size_t m_next_batch = 0;
+	bool m_stop = false;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::vector<std::thread> m_threads;
+};
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "checkpoint.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <cstdio>
+
+namespace NN
+{
+
+CheckpointWriter::CheckpointWriter(const Optimizer &optimizer, const std::string &path):
+	m_optimizer(optimizer),
+	m_path(path)
+{
+	std::ostringstream header;
+	optimizer.m_network.save_architecture(header);
+	m_header = header.str();
+
+	m_thread = std::thread(&CheckpointWriter::worker, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+void CheckpointWriter::snapshot(size_t step)
+{
+	const auto &weights = m_optimizer.m_network_weights;
+
+	m_staging.step = step;
+	m_staging.accumulated_count = m_optimizer.m_accumulated_count;
+	m_staging.values.resize(weights.size());
+	m_staging.velocities.resize(weights.size());
+
+	for(size_t i = 0; i < weights.size(); ++i)
+	{
+		m_staging.values[i] = weights[i]->m_value;
+		m_staging.velocities[i] = weights[i]->m_vel;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::swap(m_staging, m_pending);
+		m_has_pending = true;
+	}
+
+	m_cv.notify_all();
+}
+
+void CheckpointWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv.wait(lock, [this]() { return !m_has_pending && !m_busy; });
+}
+
+void CheckpointWriter::worker()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for(;;)
+	{
+		m_cv.wait(lock, [this]() { return m_has_pending || m_stop; });
+
+		// The pending snapshot is still written when stopping
+		if(!m_has_pending)
+			return;
+
+		std::swap(m_pending, m_writing);
+		m_has_pending = false;
+		m_busy = true;
+
+		lock.unlock();
+		write(m_writing);
+		lock.lock();
+
+		m_busy = false;
+		m_cv.notify_all();
+	}
+}
+
+bool CheckpointWriter::write(const Snapshot &snapshot) const
+{
+	const std::string temporary_path = m_path + ".tmp";
+	std::ofstream file {temporary_path};
+
+	if(!file)
+	{
+		std::cout << "Cannot open: \"" << temporary_path << "\"" << std::endl;
+		return false;
+	}
+
+	// Unlike save_weights, every digit is kept so that resuming gives the same run
+	file << std::setprecision(std::numeric_limits<double>::max_digits10);
+
+	file << m_header;
+	for(auto value: snapshot.values)
+		file << value << " ";
+
+	file << std::endl << snapshot.step << " " << snapshot.accumulated_count << std::endl;
+	for(auto velocity: snapshot.velocities)
+		file << velocity << " ";
+
+	file.close();
+	if(file.fail())
+	{
+		std::cout << "Cannot write: \"" << temporary_path << "\"" << std::endl;
+		return false;
+	}
+
+	// Replacing the file is atomic on POSIX, elsewhere rename fails when the destination exists
+	if(std::rename(temporary_path.c_str(), m_path.c_str()) != 0)
+	{
+		std::remove(m_path.c_str());
+		if(std::rename(temporary_path.c_str(), m_path.c_str()) != 0)
+		{
+			std::cout << "Cannot rename: \"" << temporary_path << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CheckpointWriter::restore(const std::string &path, Optimizer &optimizer, size_t &step)
+{
+	std::ifstream file {path};
+
+	if(!file)
+	{
+		std::cout << "Cannot open: \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	// Skips the header, one line per layer after the layer count
+	size_t layer_count = 0;
+	file >> layer_count;
+	for(size_t i = 0; i <= layer_count; ++i)
+		file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+	// The values were already read by load_weights
+	file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+	file >> step >> optimizer.m_accumulated_count;
+	for(const auto &v: optimizer.m_network_weights)
+		file >> v->m_vel;
+
+	bool complete = !file.fail();
+
+	// A checkpoint of a graph with more nodes, ex: written before the graph was optimized, has velocities left
+	double extra = 0.0;
+	if(!complete || file >> extra)
+	{
+		std::cout << "Invalid checkpoint: \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace NN
\ No newline at end of file
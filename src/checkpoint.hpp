@@ -0,0 +1,95 @@
+#pragma once
+
+#include "neural_network.hpp"
+#include "optimizer.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+namespace NN
+{
+
+/**
+ * @brief Saves training checkpoints without blocking the training thread: snapshot() only copies the values and
+ * the velocities of the network into a staging buffer, a background thread writes them to a temporary file and
+ * renames it over the previous checkpoint, so the file on disk is always complete.
+ * A checkpoint starts like a save_weights file (load_weights can read it) followed by the optimizer state
+ *
+ */
+class CheckpointWriter
+{
+public:
+	/**
+	 * @brief Starts the writer thread
+	 *
+	 * @param optimizer Must outlive the writer, its network can't change architecture
+	 * @param path
+	 */
+	CheckpointWriter(const Optimizer &optimizer, const std::string &path);
+
+	// Writes the last snapshot if it is still pending
+	~CheckpointWriter();
+
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter &operator=(const CheckpointWriter&) = delete;
+
+	/**
+	 * @brief Copies the current state, to be called between two optimizer steps. If the previous snapshot
+	 * isn't written yet, it is replaced by this one
+	 *
+	 * @param step Number of steps done so far, given back by restore
+	 */
+	void snapshot(size_t step);
+
+	// Blocks until the last snapshot is on disk
+	void flush();
+
+	/**
+	 * @brief Restores the velocities and the state of an optimizer from a checkpoint. The network must first be
+	 * loaded from the same file with load_weights, and the optimizer created over it
+	 *
+	 * @param path
+	 * @param optimizer
+	 * @param step Set to the value given to snapshot
+	 * @return true if the checkpoint could be read
+	 */
+	static bool restore(const std::string &path, Optimizer &optimizer, size_t &step);
+
+private:
+	struct Snapshot
+	{
+		size_t step = 0;
+		size_t accumulated_count = 0;
+		std::vector<double> values;
+		std::vector<double> velocities;
+	};
+
+	void worker();
+
+	bool write(const Snapshot &snapshot) const;
+
+	const Optimizer &m_optimizer;
+	std::string m_path;
+
+	// save_architecture's output, the architecture can't change
+	std::string m_header;
+
+	// Filled by snapshot(), then swapped with m_pending which the worker swaps with m_writing:
+	// the buffers are reused and the lock is only held for the swaps
+	Snapshot m_staging;
+	Snapshot m_pending;
+	Snapshot m_writing;
+
+	bool m_has_pending = false;
+	bool m_busy = false;
+	bool m_stop = false;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+};
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,839 @@
+#include "checks.hpp"
+#include "neural_network.hpp"
+#include "optimizer.hpp"
+#include "graph_opt.hpp"
+#include "compute_graph_expr.hpp"
+#include "utils.hpp"
+#include "idx.hpp"
+#include "augment.hpp"
+#include "dense_net.hpp"
+#include "quantized_net.hpp"
+#include "sparse_net.hpp"
+#include "static_net.hpp"
+#include "checkpoint.hpp"
+#include "distributed.hpp"
+#include "inference_server.hpp"
+#include "importance_sampler.hpp"
+#include "pipeline.hpp"
+#include "lbfgs.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <algorithm>
+
+namespace NN
+{
+
+// Largest difference allowed between two ways of computing the same value
+constexpr double check_tolerance = 1e-9;
+
+static bool close(double a, double b)
+{
+	return std::fabs(a - b) <= check_tolerance * std::max(1.0, std::fabs(b));
+}
+
+static std::vector<double> random_input(size_t size, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+	std::vector<double> input(size);
+	for(auto &x: input)
+		x = distribution(rng);
+
+	return input;
+}
+
+// Files written by the checks go to the system's temporary directory
+static std::string temporary_path(const std::string &name)
+{
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// Samples with the index of their class added to one of their inputs, so that a network can learn them
+static void random_dataset(size_t count, size_t input_size, uint32_t class_count, std::vector<double> &inputs, std::vector<uint32_t> &labels)
+{
+	inputs = random_input(count * input_size, 7);
+	labels.resize(count);
+	for(size_t i = 0; i < count; ++i)
+	{
+		labels[i] = i % class_count;
+		inputs[i * input_size + labels[i]] += 2.0;
+	}
+}
+
+static bool compare_outputs(const std::vector<double> &expected, const std::vector<double> &actual, double tolerance, const std::string &name, std::ostream &out)
+{
+	if(expected.size() != actual.size())
+	{
+		out << name << ": " << actual.size() << " outputs, expected " << expected.size() << std::endl;
+		return false;
+	}
+
+	for(size_t i = 0; i < expected.size(); ++i)
+	{
+		if(std::fabs(expected[i] - actual[i]) <= tolerance)
+			continue;
+
+		out << name << ": output " << i << " is " << actual[i] << ", expected " << expected[i] << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+// The LINEAR, RELU and SOFTMAX layers of network built with the plain operators, over copies of its parameters
+static std::vector<CG::Value> unfused_forward(
+	const NeuralNet &network,
+	const std::vector<double> &input,
+	std::vector<std::vector<CG::Value>> &leaves
+)
+{
+	std::vector<CG::Value> current_activation;
+	for(auto x: input)
+		current_activation.push_back(CG::value(x));
+
+	leaves.clear();
+	for(size_t l = 0; l < network.architecture().size(); ++l)
+	{
+		const Layer &layer = network.architecture()[l];
+		const LayerParameters &parameters = network.parameters()[l];
+
+		std::vector<CG::Value> layer_leaves;
+		for(const auto &w: parameters.weights)
+			layer_leaves.push_back(CG::value(w->value()));
+		for(const auto &b: parameters.biases)
+			layer_leaves.push_back(CG::value(b->value()));
+
+		std::vector<CG::Value> next;
+		switch(layer.operation)
+		{
+		case Layer::Func::LINEAR:
+			for(int o = 0; o < layer.output_size; ++o)
+			{
+				std::vector<CG::Value> terms {layer_leaves[layer.output_size * layer.input_size + o]};
+				for(int i = 0; i < layer.input_size; ++i)
+					terms.push_back(layer_leaves[o * layer.input_size + i] * current_activation[i]);
+
+				next.push_back(CG::list_add(terms));
+			}
+			break;
+		case Layer::Func::RELU:
+			for(const auto &v: current_activation)
+				next.push_back(CG::relu(v));
+			break;
+		case Layer::Func::SOFTMAX:
+			next = CG::softmax(current_activation);
+			break;
+		default:
+			break;
+		}
+
+		leaves.push_back(layer_leaves);
+		current_activation = next;
+	}
+
+	return current_activation;
+}
+
+// Differentials of the parameters of network, in the order of unfused_forward's leaves
+static std::vector<std::vector<double>> parameter_diffs(const NeuralNet &network)
+{
+	std::vector<std::vector<double>> diffs;
+	for(const auto &parameters: network.parameters())
+	{
+		diffs.emplace_back();
+		for(const auto &w: parameters.weights)
+			diffs.back().push_back(w->diff());
+		for(const auto &b: parameters.biases)
+			diffs.back().push_back(b->diff());
+	}
+
+	return diffs;
+}
+
+static std::vector<double> diffs(const std::vector<CG::Value> &nodes)
+{
+	std::vector<double> result;
+	for(const auto &node: nodes)
+		result.push_back(node->diff());
+
+	return result;
+}
+
+static bool compare_gradients(
+	const std::vector<std::vector<double>> &expected,
+	const std::vector<std::vector<double>> &actual,
+	const std::string &name,
+	std::ostream &out
+)
+{
+	for(size_t l = 0; l < expected.size(); ++l)
+	{
+		for(size_t i = 0; i < expected[l].size(); ++i)
+		{
+			if(close(actual[l][i], expected[l][i]))
+				continue;
+
+			out << name << ": differential " << i << " of layer " << l << " is " << actual[l][i]
+				<< ", expected " << expected[l][i] << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// The network's graph is optimized by compile(), its outputs and gradients must not change
+static bool check_optimized_graph(std::ostream &out)
+{
+	NeuralNet network({linear(6, 5), relu(), linear(5, 3), softmax()}, 1);
+	const uint32_t label = 2;
+	auto input = random_input(6, 2);
+
+	std::vector<std::vector<CG::Value>> leaves;
+	auto expected_outputs = unfused_forward(network, input, leaves);
+	auto expected_loss = CG::cross_entropy(label, expected_outputs);
+	expected_loss->backprop();
+
+	// The optimized graph has fewer nodes than the one built by unfused_forward
+	auto outputs = network.forward(input);
+	size_t fused_count = topological_sort(outputs).size();
+	size_t unfused_count = topological_sort(expected_outputs).size();
+	if(fused_count >= unfused_count)
+	{
+		out << "Optimized graph: " << fused_count << " nodes, the unfused graph has " << unfused_count << std::endl;
+		return false;
+	}
+
+	for(size_t i = 0; i < outputs.size(); ++i)
+	{
+		if(!close(outputs[i]->value(), expected_outputs[i]->value()))
+		{
+			out << "Optimized graph: output " << i << " is " << outputs[i]->value() << ", expected " << expected_outputs[i]->value() << std::endl;
+			return false;
+		}
+	}
+
+	// The optimizer pairs the nodes of the loss with the network's own by position
+	Optimizer optimizer(network);
+	optimizer.zero_grad();
+
+	auto loss = CG::cross_entropy(label, outputs);
+	loss->backprop();
+	optimizer.accumulate(loss);
+
+	if(!close(loss->value(), expected_loss->value()))
+	{
+		out << "Optimized graph: loss is " << loss->value() << ", expected " << expected_loss->value() << std::endl;
+		return false;
+	}
+
+	std::vector<std::vector<double>> expected;
+	for(const auto &layer_leaves: leaves)
+		expected.push_back(diffs(layer_leaves));
+
+	return compare_gradients(expected, parameter_diffs(network), "Optimized graph", out);
+}
+
+// The planned program of Optimizer::accumulate(input, label), and its fallback for checkpointed networks,
+// must give the gradient of the graph returned by NeuralNet::forward
+static bool check_planned_gradient(const std::string &name, const std::vector<Layer> &architecture, std::ostream &out)
+{
+	const uint32_t sample_count = 3;
+	NeuralNet network(architecture, 1);
+	size_t input_size = network.architecture().front().input_size;
+
+	Optimizer optimizer(network);
+	optimizer.zero_grad();
+	std::vector<double> expected_losses;
+	for(uint32_t s = 0; s < sample_count; ++s)
+	{
+		auto loss = CG::cross_entropy(s, network.forward(random_input(input_size, s)));
+		loss->backprop();
+		optimizer.accumulate(loss);
+		expected_losses.push_back(loss->value());
+	}
+	auto expected = parameter_diffs(network);
+
+	// Planned, then checkpointed after every layer but the last
+	for(bool checkpointed: {false, true})
+	{
+		if(checkpointed)
+			network.set_checkpoints(std::vector<bool>(architecture.size(), true));
+
+		Optimizer planned_optimizer(network);
+		planned_optimizer.zero_grad();
+		for(uint32_t s = 0; s < sample_count; ++s)
+		{
+			double loss = planned_optimizer.accumulate(random_input(input_size, s), s);
+			if(!close(loss, expected_losses[s]))
+			{
+				out << name << (checkpointed ? " (checkpointed)": "") << ": loss of sample " << s << " is " << loss
+					<< ", expected " << expected_losses[s] << std::endl;
+				return false;
+			}
+		}
+
+		if(!compare_gradients(expected, parameter_diffs(network), name + (checkpointed ? " (checkpointed)": ""), out))
+			return false;
+	}
+
+	return true;
+}
+
+static bool check_planned_mlp(std::ostream &out)
+{
+	return check_planned_gradient("Planned MLP", {linear(6, 5), relu(), linear(5, 3), softmax()}, out);
+}
+
+static bool check_planned_conv(std::ostream &out)
+{
+	return check_planned_gradient("Planned conv net", {
+		conv2d(1, 6, 6, 2, 3), relu(), maxpool2d(2, 4, 4, 2), linear(8, 3), softmax()
+	}, out);
+}
+
+// An elementwise expression, written outside of namespace CG, must match the same graph built node by node
+static bool check_expression(std::ostream &out)
+{
+	const size_t size = 8;
+	auto a_values = random_input(size, 3), b_values = random_input(size, 4), c_values = random_input(size, 5);
+
+	std::vector<CG::Value> a, b, c;
+	std::vector<CG::Value> expected_a, expected_b, expected_c;
+	for(size_t i = 0; i < size; ++i)
+	{
+		a.push_back(CG::value(a_values[i]));
+		b.push_back(CG::value(b_values[i]));
+		c.push_back(CG::value(c_values[i]));
+		expected_a.push_back(CG::value(a_values[i]));
+		expected_b.push_back(CG::value(b_values[i]));
+		expected_c.push_back(CG::value(c_values[i]));
+	}
+
+	auto outputs = CG::eval(CG::relu(a*b + c - 0.5));
+	auto loss = CG::list_add(CG::eval(outputs * outputs));
+
+	std::vector<CG::Value> expected_outputs;
+	for(size_t i = 0; i < size; ++i)
+		expected_outputs.push_back(CG::relu(expected_a[i] * expected_b[i] + expected_c[i] - CG::constant(0.5)));
+
+	std::vector<CG::Value> squares;
+	for(const auto &output: expected_outputs)
+		squares.push_back(output * output);
+	auto expected_loss = CG::list_add(squares);
+
+	loss->backprop();
+	expected_loss->backprop();
+
+	if(!close(loss->value(), expected_loss->value()))
+	{
+		out << "Expression: loss is " << loss->value() << ", expected " << expected_loss->value() << std::endl;
+		return false;
+	}
+
+	return compare_gradients({diffs(expected_a), diffs(expected_b), diffs(expected_c)}, {diffs(a), diffs(b), diffs(c)}, "Expression", out);
+}
+
+// A big endian int16 file is read with its shape and signs, and a file too short for its header is rejected
+static bool check_idx(std::ostream &out)
+{
+	const std::string path = temporary_path("autograd_nn_check.idx");
+	const std::vector<int16_t> values {-300, -1, 0, 1, 255, 32767};
+
+	auto write = [&](size_t value_count) {
+		std::ofstream file {path, std::ios::out | std::ios::binary};
+		const uint8_t header[12] = {0, 0, 0x0B, 2, 0, 0, 0, 2, 0, 0, 0, 3};
+		file.write((const char*)header, sizeof(header));
+		for(size_t i = 0; i < value_count; ++i)
+		{
+			const uint8_t bytes[2] = {uint8_t(uint16_t(values[i]) >> 8), uint8_t(uint16_t(values[i]) & 0xFF)};
+			file.write((const char*)bytes, 2);
+		}
+	};
+
+	write(values.size());
+	auto tensor = IDX::load(path);
+	std::vector<double> loaded(tensor.element_count());
+	tensor.to_double(loaded.data(), 0, loaded.size());
+
+	bool success = tensor.dtype == IDX::DType::I16 && tensor.shape == std::vector<uint32_t>{2, 3} &&
+		compare_outputs(std::vector<double>(values.begin(), values.end()), loaded, 0.0, "IDX", out);
+
+	write(values.size() - 1);
+	try
+	{
+		IDX::load(path);
+		out << "IDX: a truncated file was loaded" << std::endl;
+		success = false;
+	}
+	catch(const std::runtime_error &)
+	{
+	}
+
+	std::remove(path.c_str());
+	return success;
+}
+
+// The batches only depend on their index, whatever the number of threads or the first batch
+static bool check_augmentation(std::ostream &out)
+{
+	std::vector<Image> images;
+	std::vector<uint32_t> labels;
+	for(uint32_t k = 0; k < 20; ++k)
+	{
+		std::vector<uint8_t> pixels(12 * 12);
+		for(size_t i = 0; i < pixels.size(); ++i)
+			pixels[i] = (i * 7 + k * 13) % 256;
+
+		images.emplace_back(pixels, 12, 12);
+		labels.push_back(k % 10);
+	}
+
+	AugmentParams params;
+	params.elastic_alpha = 8.0f;
+
+	AugmentedBatchLoader one_thread(images, labels, params, 6, 1);
+	AugmentedBatchLoader three_threads(images, labels, params, 6, 3);
+	AugmentedBatchLoader resumed(images, labels, params, 6, 2, 4, 0, 3);
+
+	for(size_t batch = 0; batch < 6; ++batch)
+	{
+		Batch expected = one_thread.next();
+		Batch actual = three_threads.next();
+		bool same = expected.inputs == actual.inputs && expected.labels == actual.labels;
+
+		if(same && batch >= 3)
+		{
+			Batch resumed_batch = resumed.next();
+			same = expected.inputs == resumed_batch.inputs && expected.labels == resumed_batch.labels;
+		}
+
+		if(!same)
+		{
+			out << "Augmentation: batch " << batch << " differs between loaders" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// The int8 network stays within a quantization error of the float one on its calibration samples
+static bool check_quantization(std::ostream &out)
+{
+	const size_t sample_count = 64;
+	NeuralNet network({linear(16, 12), relu(), linear(12, 4), softmax()}, 1);
+	DenseNet dense(network);
+	auto inputs = random_input(sample_count * 16, 8);
+
+	QuantizedNet quantized(dense, inputs.data(), sample_count);
+	return compare_outputs(dense.forward(inputs.data(), sample_count), quantized.forward(inputs.data(), sample_count), 0.02, "Quantization", out);
+}
+
+// StaticNet computes the outputs of the NeuralNet it was loaded from
+static bool check_static_net(std::ostream &out)
+{
+	NeuralNet network({linear(6, 5), relu(), linear(5, 3), softmax()}, 1);
+	StaticNet<Linear<6, 5>, ReLU, Linear<5, 3>, Softmax> static_net;
+	if(!static_net.load(network))
+	{
+		out << "StaticNet: the architecture was rejected" << std::endl;
+		return false;
+	}
+
+	auto input = random_input(6, 9);
+	std::array<double, 6> static_input;
+	std::copy(input.begin(), input.end(), static_input.begin());
+
+	auto output = static_net.forward(static_input);
+	std::vector<double> expected;
+	for(const auto &v: network.forward(input))
+		expected.push_back(v->value());
+
+	return compare_outputs(expected, std::vector<double>(output.begin(), output.end()), check_tolerance, "StaticNet", out);
+}
+
+// Restoring a checkpoint gives back the step, the parameters and their velocities
+static bool check_checkpoint(std::ostream &out)
+{
+	const std::string path = temporary_path("autograd_nn_check_checkpoint.txt");
+	NeuralNet network({linear(6, 5), relu(), linear(5, 3), softmax()}, 1);
+
+	{
+		Optimizer optimizer(network, 0.1, 0.9);
+		for(uint32_t step = 0; step < 3; ++step)
+		{
+			optimizer.zero_grad();
+			optimizer.accumulate(random_input(6, step), step % 3);
+			optimizer.step();
+		}
+
+		CheckpointWriter writer(optimizer, path);
+		writer.snapshot(3);
+		writer.flush();
+	}
+
+	NeuralNet restored;
+	size_t step = 0;
+	bool loaded = restored.load_weights(path);
+	if(loaded)
+	{
+		Optimizer optimizer(restored, 0.1, 0.9);
+		loaded = CheckpointWriter::restore(path, optimizer, step);
+	}
+
+	std::remove(path.c_str());
+	if(!loaded || step != 3)
+	{
+		out << "Checkpoint: restored step " << step << ", expected 3" << std::endl;
+		return false;
+	}
+
+	for(size_t l = 0; l < network.parameters().size(); ++l)
+	{
+		const auto &expected = network.parameters()[l];
+		const auto &actual = restored.parameters()[l];
+		for(size_t i = 0; i < expected.weights.size(); ++i)
+		{
+			if(expected.weights[i]->value() == actual.weights[i]->value() && expected.weights[i]->m_vel == actual.weights[i]->m_vel)
+				continue;
+
+			out << "Checkpoint: weight " << i << " of layer " << l << " or its velocity differs" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Every process of the ring ends with the same sums, over a count that doesn't divide into equal chunks
+static bool check_all_reduce(std::ostream &out)
+{
+	const int world_size = 3;
+	const size_t count = 10;
+	const uint16_t base_port = 29700;
+
+	std::vector<std::vector<double>> data(world_size, std::vector<double>(count));
+	for(int rank = 0; rank < world_size; ++rank)
+	{
+		for(size_t i = 0; i < count; ++i)
+			data[rank][i] = rank * 100.0 + i * 0.25;
+	}
+
+	std::vector<bool> failed(world_size, false);
+	std::vector<std::thread> threads;
+	for(int rank = 0; rank < world_size; ++rank)
+	{
+		threads.emplace_back([&, rank]() {
+			try
+			{
+				RingAllReduce ring(rank, world_size, "127.0.0.1", base_port);
+				ring.sum(data[rank].data(), count);
+			}
+			catch(const std::runtime_error &)
+			{
+				failed[rank] = true;
+			}
+		});
+	}
+
+	for(auto &thread: threads)
+		thread.join();
+
+	if(std::find(failed.begin(), failed.end(), true) != failed.end())
+	{
+		out << "All-reduce: the ring could not be connected on ports " << base_port << "+" << std::endl;
+		return false;
+	}
+
+	std::vector<double> expected(count);
+	for(size_t i = 0; i < count; ++i)
+		expected[i] = 300.0 + 3 * i * 0.25;
+
+	for(int rank = 0; rank < world_size; ++rank)
+	{
+		if(!compare_outputs(expected, data[rank], check_tolerance, "All-reduce, rank " + std::to_string(rank), out))
+			return false;
+	}
+
+	return data[0] == data[1] && data[1] == data[2];
+}
+
+// Pipelined requests are batched, and their answers come back in order with the outputs of the network
+static bool check_server(std::ostream &out)
+{
+	const size_t request_count = 10;
+	NeuralNet network({linear(6, 5), relu(), linear(5, 3), softmax()}, 1);
+	DenseNet dense(network);
+
+	ServerSettings settings;
+	settings.socket_path = temporary_path("autograd_nn_check.sock");
+	settings.max_batch_size = 5;
+	settings.latency_budget = std::chrono::microseconds(1000000);
+
+	InferenceServer server(network, settings);
+	std::thread server_thread(&InferenceServer::run, &server);
+
+	std::vector<uint8_t> requests(request_count * 6);
+	for(size_t i = 0; i < requests.size(); ++i)
+		requests[i] = (i * 37) % 256;
+
+	std::vector<double> inputs(requests.begin(), requests.end());
+	for(auto &x: inputs)
+		x /= 255.0;
+	auto expected = dense.forward(inputs.data(), request_count);
+
+	const size_t answer_size = 1 + 3 * sizeof(float);
+	std::vector<uint8_t> answers(request_count * answer_size);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+	std::strncpy(address.sun_path, settings.socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+	bool exchanged = fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+		send(fd, requests.data(), requests.size(), 0) == (ssize_t)requests.size();
+
+	for(size_t received = 0; exchanged && received < answers.size();)
+	{
+		ssize_t size = recv(fd, answers.data() + received, answers.size() - received, 0);
+		exchanged = size > 0;
+		received += exchanged ? size: 0;
+	}
+
+	if(fd >= 0)
+		::close(fd);
+
+	server.stop();
+	server_thread.join();
+
+	if(!exchanged)
+	{
+		out << "Server: the requests could not be sent or answered" << std::endl;
+		return false;
+	}
+
+	std::vector<double> outputs;
+	for(size_t i = 0; i < request_count; ++i)
+	{
+		const uint8_t *answer = answers.data() + i * answer_size;
+		for(size_t j = 0; j < 3; ++j)
+		{
+			float value;
+			std::memcpy(&value, answer + 1 + j * sizeof(float), sizeof(float));
+			outputs.push_back(value);
+		}
+
+		auto first = expected.begin() + i * 3;
+		if(answer[0] != std::max_element(first, first + 3) - first)
+		{
+			out << "Server: answer " << i << " predicts " << int(answer[0]) << std::endl;
+			return false;
+		}
+	}
+
+	auto stats = server.stats();
+	if(stats.requests != request_count || stats.batches != request_count / settings.max_batch_size)
+	{
+		out << "Server: " << stats.requests << " requests in " << stats.batches << " batches" << std::endl;
+		return false;
+	}
+
+	return compare_outputs(expected, outputs, 1e-6, "Server", out);
+}
+
+// The CSR forward matches the dense one, and the pruned weights stay at 0 through the optimizer's steps
+static bool check_pruning(std::ostream &out)
+{
+	NeuralNet network({linear(16, 12), relu(), linear(12, 4), softmax()}, 1);
+	network.prune(0.5);
+
+	Optimizer optimizer(network, 0.1, 0.9);
+	for(uint32_t step = 0; step < 3; ++step)
+	{
+		optimizer.zero_grad();
+		optimizer.accumulate(random_input(16, step), step % 4);
+		optimizer.step();
+	}
+
+	for(const auto &parameters: network.parameters())
+	{
+		for(size_t i = 0; i < parameters.mask.size(); ++i)
+		{
+			if(parameters.mask[i] || parameters.weights[i]->value() == 0.0)
+				continue;
+
+			out << "Pruning: masked weight " << i << " is " << parameters.weights[i]->value() << std::endl;
+			return false;
+		}
+	}
+
+	DenseNet dense(network);
+	SparseNet sparse(dense);
+	auto inputs = random_input(8 * 16, 10);
+
+	return compare_outputs(dense.forward(inputs.data(), 8), sparse.forward(inputs.data(), 8), check_tolerance, "Pruning", out);
+}
+
+// The probabilities follow the priorities (loss + epsilon)^alpha, and the weights of a batch average 1
+static bool check_sampler(std::ostream &out)
+{
+	const std::vector<double> losses {0.5, 2.0, 0.0, 1.0, 4.0};
+	ImportanceSettings settings;
+	ImportanceSampler sampler(losses.size(), settings, 1);
+
+	double total = 0.0;
+	for(uint32_t i = 0; i < losses.size(); ++i)
+	{
+		sampler.update(i, losses[i]);
+		total += std::pow(losses[i] + settings.epsilon, settings.alpha);
+	}
+
+	std::vector<double> expected, probabilities;
+	for(uint32_t i = 0; i < losses.size(); ++i)
+	{
+		expected.push_back(std::pow(losses[i] + settings.epsilon, settings.alpha) / total);
+		probabilities.push_back(sampler.probability(i));
+	}
+
+	if(!compare_outputs(expected, probabilities, check_tolerance, "Sampler", out))
+		return false;
+
+	std::vector<uint32_t> indices;
+	std::vector<double> weights;
+	sampler.sample(16, indices, weights);
+
+	double weight_total = 0.0;
+	for(size_t i = 0; i < indices.size(); ++i)
+	{
+		if(indices[i] >= losses.size())
+		{
+			out << "Sampler: drew sample " << indices[i] << std::endl;
+			return false;
+		}
+
+		weight_total += weights[i];
+	}
+
+	return compare_outputs({1.0}, {weight_total / weights.size()}, check_tolerance, "Sampler weights", out);
+}
+
+// The stages of the pipeline add up to the gradient of the whole network
+static bool check_pipeline(std::ostream &out)
+{
+	const size_t batch_size = 7;
+	NeuralNet network({linear(6, 8), relu(), linear(8, 5), relu(), linear(5, 3), softmax()}, 1);
+	DenseNet dense(network);
+	PipelinedNet pipeline(dense, 3, 2);
+
+	std::vector<double> inputs;
+	std::vector<uint32_t> labels;
+	random_dataset(batch_size, 6, 3, inputs, labels);
+
+	std::vector<double> expected(dense.parameter_count(), 0.0), actual(dense.parameter_count(), 0.0);
+	double expected_loss = dense.gradient(inputs.data(), labels.data(), batch_size, expected.data());
+	double loss = pipeline.gradient(inputs.data(), labels.data(), batch_size, actual.data());
+
+	return compare_outputs({expected_loss}, {loss}, check_tolerance, "Pipeline loss", out) &&
+		compare_outputs(expected, actual, check_tolerance, "Pipeline gradient", out);
+}
+
+// Each accepted step decreases the loss, and the result doesn't depend on the number of threads
+static bool check_lbfgs(std::ostream &out)
+{
+	const size_t sample_count = 60;
+	std::vector<double> inputs;
+	std::vector<uint32_t> labels;
+	random_dataset(sample_count, 6, 3, inputs, labels);
+
+	std::vector<double> final_losses;
+	for(unsigned thread_count: {1u, 3u})
+	{
+		NeuralNet network({linear(6, 5), relu(), linear(5, 3), softmax()}, 1);
+		DenseNet dense(network);
+
+		LBFGSSettings settings;
+		settings.chunk_size = 7;
+		settings.thread_count = thread_count;
+		LBFGS lbfgs(dense, inputs.data(), labels.data(), sample_count, settings);
+		const double initial_loss = lbfgs.loss();
+
+		for(int step = 0; step < 10; ++step)
+		{
+			double previous = lbfgs.loss();
+			if(lbfgs.step() && !(lbfgs.loss() < previous))
+			{
+				out << "L-BFGS: step " << step << " went from " << previous << " to " << lbfgs.loss() << std::endl;
+				return false;
+			}
+		}
+
+		if(!(lbfgs.loss() < initial_loss))
+		{
+			out << "L-BFGS: the loss went from " << initial_loss << " to " << lbfgs.loss() << std::endl;
+			return false;
+		}
+
+		final_losses.push_back(lbfgs.loss());
+	}
+
+	if(final_losses[0] != final_losses[1])
+	{
+		out << "L-BFGS: final loss " << final_losses[0] << " with 1 thread, " << final_losses[1] << " with 3" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool run_checks(std::ostream &out)
+{
+	struct Check
+	{
+		const char *name;
+		bool (*run)(std::ostream&);
+	};
+
+	const Check checks[] = {
+		{"optimized graph", check_optimized_graph},
+		{"expression", check_expression},
+		{"planned MLP", check_planned_mlp},
+		{"planned conv net", check_planned_conv},
+		{"IDX reader", check_idx},
+		{"augmentation", check_augmentation},
+		{"quantization", check_quantization},
+		{"static net", check_static_net},
+		{"checkpoint", check_checkpoint},
+		{"all-reduce", check_all_reduce},
+		{"server", check_server},
+		{"pruning", check_pruning},
+		{"importance sampler", check_sampler},
+		{"pipeline", check_pipeline},
+		{"L-BFGS", check_lbfgs},
+	};
+
+	bool success = true;
+	for(const auto &check: checks)
+	{
+		bool passed = check.run(out);
+		out << (passed ? "Passed: ": "FAILED: ") << check.name << std::endl;
+		success = success && passed;
+	}
+
+	return success;
+}
+
+} // namespace NN
\ No newline at end of file
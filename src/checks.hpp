@@ -0,0 +1,17 @@
+#pragma once
+
+#include <ostream>
+
+namespace NN
+{
+
+/**
+ * @brief Compares the fast paths of the library with the straightforward implementations they replace, on small
+ * networks with fixed seeds. Each failed comparison is described on out
+ * 
+ * @param out 
+ * @return true if every check passed
+ */
+bool run_checks(std::ostream &out);
+
+} // namespace NN
\ No newline at end of file
@@ -9,23 +9,43 @@
 namespace CG 
 {
 
-constexpr double cross_entropy_epsilon = 1e-4;
+static uint32_t argmax(const std::vector<Value> &nodes)
+{
+	uint32_t best = 0;
+	for(uint32_t i = 1; i < nodes.size(); ++i)
+	{
+		if(nodes[i]->value() > nodes[best]->value())
+			best = i;
+	}
+
+	return best;
+}
 
 CG::CG(double value):
 	m_value(value)
 {
 }
 
-void CG::backprop()
+size_t CG::backprop()
 {
 	auto sort = topological_sort(m_children);
 	m_diff = 1.0;
 	backward();
 
-	for(auto node: sort)
+	// Every parent of a node comes before it in the sort, so its differential is final once reached.
+	// A node with a zero differential would only add zeros to its children: skipping it prunes
+	// whole subgraphs below dead relus and zero inputs
+	size_t active_count = 1;
+	for(const auto &node: sort)
 	{
+		if(node->m_diff == 0.0)
+			continue;
+
 		node->backward();
+		++active_count;
 	}
+
+	return active_count;
 }
 
 void CG::forward()
@@ -65,6 +85,28 @@ void CG::forward()
 	case Op::RELU:
 		m_value = m_children[0]->m_value > 0.0 ? m_children[0]->m_value: 0.0;
 		break;
+	case Op::MAX:
+		assert(m_children.size() > 0);
+		m_value = m_children[argmax(m_children)]->m_value;
+		break;
+	case Op::DOT:
+	case Op::DOT_RELU:
+	{
+		assert((m_children.size() - m_input_index) % 2 == 0);
+		m_value = 0.0;
+		for(uint32_t i = 0; i < m_input_index; ++i)
+			m_value += m_children[i]->m_value;
+		for(size_t i = m_input_index; i < m_children.size(); i += 2)
+			m_value += m_children[i]->m_value * m_children[i+1]->m_value;
+
+		if(m_op == Op::DOT_RELU && m_value < 0.0)
+			m_value = 0.0;
+		break;
+	}
+	case Op::SEGMENT:
+	case Op::SEGMENT_OUTPUT:
+		// The values are set when the segment is created
+		break;
 	default:
 		assert(false);
 		break;
@@ -109,6 +151,35 @@ void CG::backward()
 	case Op::CROSS_ENTHROPY:
 		m_children[m_input_index]->m_diff -= m_diff / (m_children[m_input_index]->m_value + cross_entropy_epsilon);
 		break;
+	case Op::MAX:
+		// Recomputed rather than stored, NeuralNet::forward only copies the values to the graph it returns
+		m_children[argmax(m_children)]->m_diff += m_diff;
+		break;
+	case Op::DOT_RELU:
+		if(m_value <= 0.0)
+			break;
+		[[fallthrough]];
+	case Op::DOT:
+		for(uint32_t i = 0; i < m_input_index; ++i)
+			m_children[i]->m_diff += m_diff;
+		for(size_t i = m_input_index; i < m_children.size(); i += 2)
+		{
+			m_children[i]->m_diff += m_diff * m_children[i+1]->value();
+			m_children[i+1]->m_diff += m_diff * m_children[i]->value();
+		}
+		break;
+	case Op::SEGMENT_OUTPUT:
+	{
+		auto segment = static_cast<Segment*>(m_children[0].get());
+		segment->m_output_diffs[m_input_index] += m_diff;
+
+		// Only marks the segment as reached, so that backprop doesn't skip it
+		segment->m_diff = 1.0;
+		break;
+	}
+	case Op::SEGMENT:
+		static_cast<Segment*>(this)->backward_segment();
+		break;
 	default: 
 		assert(false);
 		break;
@@ -120,6 +191,27 @@ Value value(double val)
 	return std::make_shared<CG>(val);
 }
 
+std::vector<Value> allocate(size_t count)
+{
+	auto block = std::make_shared<std::vector<CG>>(count, CG(0.0));
+
+	// Every node shares the ownership of the block
+	std::vector<Value> ret;
+	ret.reserve(count);
+	for(auto &node: *block)
+		ret.emplace_back(block, &node);
+
+	return ret;
+}
+
+Value constant(double val)
+{
+	auto ptr = std::make_shared<CG>(val);
+	ptr->m_constant = true;
+
+	return ptr;
+}
+
 Value operator+(const Value &left, const Value &right)
 {
 	auto ptr = std::make_shared<CG>(0.0);
@@ -145,6 +237,52 @@ Value list_add(const std::vector<Value> &input)
 	return ptr;
 }
 
+Value dot(const std::vector<Value> &addends, const std::vector<Value> &products)
+{
+	assert(products.size() % 2 == 0);
+	auto ptr = std::make_shared<CG>(0.0);
+
+	ptr->m_children = addends;
+	ptr->m_children.insert(ptr->m_children.end(), products.begin(), products.end());
+	ptr->m_op = Op::DOT;
+	ptr->m_input_index = addends.size();
+	ptr->forward();
+	
+	return ptr;
+}
+
+std::vector<Value> segment_outputs(const std::shared_ptr<Segment> &segment, const std::vector<double> &values)
+{
+	segment->m_output_diffs.assign(values.size(), 0.0);
+
+	std::vector<Value> ret;
+	ret.reserve(values.size());
+
+	for(size_t i = 0; i < values.size(); ++i)
+	{
+		auto ptr = std::make_shared<CG>(values[i]);
+
+		ptr->m_children.push_back(segment);
+		ptr->m_op = Op::SEGMENT_OUTPUT;
+		ptr->m_input_index = i;
+
+		ret.push_back(ptr);
+	}
+
+	return ret;
+}
+
+Value max(const std::vector<Value> &input)
+{
+	auto ptr = std::make_shared<CG>(0.0);
+
+	ptr->m_children = input;
+	ptr->m_op = Op::MAX;
+	ptr->forward();
+	
+	return ptr;
+}
+
 Value operator-(const Value &left, const Value &right)
 {
 	auto ptr = std::make_shared<CG>(0.0);
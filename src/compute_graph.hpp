@@ -2,13 +2,15 @@
 
 #include <memory>
 #include <vector>
+#include <cstddef>
+#include <cstdint>
 
 namespace CG 
 {
 
 enum class Op
 {
-	ADD, SUB, MUL, RELU, SOFTMAX,	CROSS_ENTHROPY,	LEAF
+	ADD, SUB, MUL, RELU, SOFTMAX,	CROSS_ENTHROPY,	MAX, DOT, DOT_RELU, SEGMENT, SEGMENT_OUTPUT, LEAF
 };
 
 class CG
@@ -27,10 +29,11 @@ public:
 	inline double diff() const {return m_diff; }
 
 	/**
-	 * @brief Initiate backpropagation from this node's value
+	 * @brief Initiate backpropagation from this node's value. Nodes that received a zero differential are skipped
 	 * 
+	 * @return size_t How many nodes received a non zero differential, this one included
 	 */
-	void backprop();
+	size_t backprop();
 
 	void backward();
 
@@ -44,23 +47,66 @@ public:
 
 	// If the operation is "Softmax", what index of the output of softmax on m_children does this node corresponds to ?
 	// If the operation is "CrossEntrhopy", what is the index of the correct class ?
+	// If the operation is "Dot" or "DotRelu", how many children are plain addends ? (the others are multiplied two by two)
+	// If the operation is "SegmentOutput", what output of the segment does this node corresponds to ?
 	uint32_t m_input_index {0};
 
 	// The actual value of the node
 	double m_value {0.0};
 
+	// Set on leaves which will never change, see CG::constant
+	bool m_constant {false};
+
 	// The differential of some loss (the called of .backward()) over m_value
 	double m_diff {0.0};
 	
 	// Used to store the velocity for optimization
 	double m_vel {0.0};
+
+	// Scratch fields of topological_sort: the last traversal which reached the node, and its position
+	// in that sort counted from the end
+	uint64_t m_traversal {0};
+	uint32_t m_post_order {0};
 };
 
 
 using Value = std::shared_ptr<CG>;
 
+/**
+ * @brief Node standing for a group of nodes that are not kept in memory. Its children are the inputs of the group,
+ * and its outputs are SEGMENT_OUTPUT nodes (see CG::segment_outputs). Once they all received their differential,
+ * backward_segment rebuilds the group to propagate them
+ * 
+ */
+class Segment: public CG
+{
+public:
+	Segment(): CG(0.0) { m_op = Op::SEGMENT; }
+
+	virtual ~Segment() = default;
+
+	// Adds to the children's m_diff the differential of the outputs (m_output_diffs) over them
+	virtual void backward_segment() = 0;
+
+	// The differentials received by each output
+	std::vector<double> m_output_diffs;
+};
+
 Value value(double val);
 
+/**
+ * @brief Creates count leaves of value 0 with a single allocation, their memory is released once none of them
+ * is referenced anymore. The builders of large graphs then turn them into the nodes they need, which must not
+ * have children in the same block: the block would then own itself and never be released
+ * 
+ * @param count 
+ * @return std::vector<Value> 
+ */
+std::vector<Value> allocate(size_t count);
+
+// A leaf that the graph optimizations are allowed to fold into the nodes using it
+Value constant(double val);
+
 Value operator+(const Value &left, const Value &right);
 
 Value operator-(const Value &left, const Value &right);
@@ -69,6 +115,9 @@ Value operator*(const Value &left, const Value &right);
 
 Value relu(const Value &cg);
 
+// Added to the probability in the log of cross_entropy, shared by every implementation of the loss
+constexpr double cross_entropy_epsilon = 1e-4;
+
 Value cross_entropy(
 	uint32_t y_real,
 	const std::vector<Value> &logits
@@ -78,4 +127,19 @@ std::vector<Value> softmax( const std::vector<Value> &input );
 
 Value list_add(const std::vector<Value> &input);
 
+// addends[0] + ... + addends[n-1] + products[0]*products[1] + products[2]*products[3] + ...
+Value dot(const std::vector<Value> &addends, const std::vector<Value> &products);
+
+/**
+ * @brief Creates the output nodes of a segment
+ * 
+ * @param segment Its children must already be set
+ * @param values The value of each output
+ * @return std::vector<Value> 
+ */
+std::vector<Value> segment_outputs(const std::shared_ptr<Segment> &segment, const std::vector<double> &values);
+
+// Largest value of the input, the gradient only flows to the first maximum
+Value max(const std::vector<Value> &input);
+
 } // CG
\ No newline at end of file
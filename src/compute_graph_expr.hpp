@@ -0,0 +1,305 @@
+#pragma once
+
+#include "compute_graph.hpp"
+
+#include <vector>
+#include <memory>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+namespace CG
+{
+
+/**
+ * Lazy elementwise expressions over vectors of nodes: with a, b, c, d of type std::vector<Value>,
+ * relu(a*b + c - d) only builds an expression type. CG::eval then computes it in a single loop,
+ * without any intermediate node, and returns one output node per element. All of them hang from a
+ * single Segment node, which computes the whole backward pass in a single loop too.
+ * 
+ * The expression keeps pointers to its operands, it must be evaluated before they are destroyed
+ */
+namespace expr
+{
+
+// Each expression type has an arity (how many vector operands it reads), at<Offset>(i, columns), the value of element i where
+// columns[Offset + k] holds the values of its k-th operand, and grad<Offset>(i, seed, columns, grads), which adds
+// seed * d(value)/d(operand k) to grads[Offset + k][i]
+
+struct Var
+{
+	static constexpr size_t arity = 1;
+
+	template<size_t Offset>
+	inline double at(size_t i, const double *const *columns) const { return columns[Offset][i]; }
+
+	template<size_t Offset>
+	inline void grad(size_t i, double seed, const double *const *, double *const *grads) const { grads[Offset][i] += seed; }
+
+	void operands(std::vector<const std::vector<Value>*> &out) const { out.push_back(values); }
+
+	const std::vector<Value> *values;
+};
+
+struct Scalar
+{
+	static constexpr size_t arity = 0;
+
+	template<size_t Offset>
+	inline double at(size_t, const double *const *) const { return value; }
+
+	template<size_t Offset>
+	inline void grad(size_t, double, const double *const *, double *const *) const {}
+
+	void operands(std::vector<const std::vector<Value>*> &) const {}
+
+	double value;
+};
+
+template<typename L, typename R>
+struct Add
+{
+	static constexpr size_t arity = L::arity + R::arity;
+
+	template<size_t Offset>
+	inline double at(size_t i, const double *const *columns) const
+	{
+		return left.template at<Offset>(i, columns) + right.template at<Offset + L::arity>(i, columns);
+	}
+
+	template<size_t Offset>
+	inline void grad(size_t i, double seed, const double *const *columns, double *const *grads) const
+	{
+		left.template grad<Offset>(i, seed, columns, grads);
+		right.template grad<Offset + L::arity>(i, seed, columns, grads);
+	}
+
+	void operands(std::vector<const std::vector<Value>*> &out) const { left.operands(out); right.operands(out); }
+
+	L left;
+	R right;
+};
+
+template<typename L, typename R>
+struct Sub
+{
+	static constexpr size_t arity = L::arity + R::arity;
+
+	template<size_t Offset>
+	inline double at(size_t i, const double *const *columns) const
+	{
+		return left.template at<Offset>(i, columns) - right.template at<Offset + L::arity>(i, columns);
+	}
+
+	template<size_t Offset>
+	inline void grad(size_t i, double seed, const double *const *columns, double *const *grads) const
+	{
+		left.template grad<Offset>(i, seed, columns, grads);
+		right.template grad<Offset + L::arity>(i, -seed, columns, grads);
+	}
+
+	void operands(std::vector<const std::vector<Value>*> &out) const { left.operands(out); right.operands(out); }
+
+	L left;
+	R right;
+};
+
+template<typename L, typename R>
+struct Mul
+{
+	static constexpr size_t arity = L::arity + R::arity;
+
+	template<size_t Offset>
+	inline double at(size_t i, const double *const *columns) const
+	{
+		return left.template at<Offset>(i, columns) * right.template at<Offset + L::arity>(i, columns);
+	}
+
+	template<size_t Offset>
+	inline void grad(size_t i, double seed, const double *const *columns, double *const *grads) const
+	{
+		left.template grad<Offset>(i, seed * right.template at<Offset + L::arity>(i, columns), columns, grads);
+		right.template grad<Offset + L::arity>(i, seed * left.template at<Offset>(i, columns), columns, grads);
+	}
+
+	void operands(std::vector<const std::vector<Value>*> &out) const { left.operands(out); right.operands(out); }
+
+	L left;
+	R right;
+};
+
+template<typename E>
+struct Relu
+{
+	static constexpr size_t arity = E::arity;
+
+	template<size_t Offset>
+	inline double at(size_t i, const double *const *columns) const
+	{
+		double value = inner.template at<Offset>(i, columns);
+		return value > 0.0 ? value: 0.0;
+	}
+
+	template<size_t Offset>
+	inline void grad(size_t i, double seed, const double *const *columns, double *const *grads) const
+	{
+		if(inner.template at<Offset>(i, columns) > 0.0)
+			inner.template grad<Offset>(i, seed, columns, grads);
+	}
+
+	void operands(std::vector<const std::vector<Value>*> &out) const { inner.operands(out); }
+
+	E inner;
+};
+
+template<typename T> struct is_node {static constexpr bool value = false; };
+template<typename L, typename R> struct is_node<Add<L, R>> {static constexpr bool value = true; };
+template<typename L, typename R> struct is_node<Sub<L, R>> {static constexpr bool value = true; };
+template<typename L, typename R> struct is_node<Mul<L, R>> {static constexpr bool value = true; };
+template<typename E> struct is_node<Relu<E>> {static constexpr bool value = true; };
+
+// Vectors of nodes and expression nodes can be used as operands
+template<typename T>
+constexpr bool is_expression = is_node<T>::value || std::is_same_v<T, std::vector<Value>>;
+
+// Numbers can too, as long as the other operand is an expression
+template<typename L, typename R>
+constexpr bool are_operands = (is_expression<L> || is_expression<R>) &&
+	(is_expression<L> || std::is_arithmetic_v<L>) && (is_expression<R> || std::is_arithmetic_v<R>);
+
+template<typename T>
+inline auto wrap(const T &operand)
+{
+	if constexpr(std::is_same_v<T, std::vector<Value>>)
+		return Var{&operand};
+	else if constexpr(std::is_arithmetic_v<T>)
+		return Scalar{static_cast<double>(operand)};
+	else
+		return operand;
+}
+
+template<typename T>
+using wrapped = decltype(wrap(std::declval<const T&>()));
+
+/**
+ * @brief Segment evaluating an expression: its children are the elements of each operand, one operand after the other
+ * 
+ */
+template<typename E>
+class ExprSegment: public Segment
+{
+public:
+	ExprSegment(const E &expression, const std::vector<const std::vector<Value>*> &operands, size_t size):
+		m_expression(expression), m_size(size), m_columns(E::arity * size)
+	{
+		m_children.reserve(E::arity * size);
+		for(size_t k = 0; k < operands.size(); ++k)
+		{
+			assert(operands[k]->size() == size);
+			for(size_t i = 0; i < size; ++i)
+			{
+				m_children.push_back((*operands[k])[i]);
+				m_columns[k * size + i] = (*operands[k])[i]->value();
+			}
+		}
+	}
+
+	std::vector<double> evaluate() const
+	{
+		auto columns = column_pointers(m_columns);
+		std::vector<double> values(m_size);
+
+		for(size_t i = 0; i < m_size; ++i)
+			values[i] = m_expression.template at<0>(i, columns.data());
+
+		return values;
+	}
+
+	void backward_segment() override
+	{
+		std::vector<double> diffs(E::arity * m_size, 0.0);
+		auto columns = column_pointers(m_columns);
+		auto grads = column_pointers(diffs);
+
+		for(size_t i = 0; i < m_size; ++i)
+			m_expression.template grad<0>(i, m_output_diffs[i], columns.data(), grads.data());
+
+		for(size_t i = 0; i < m_children.size(); ++i)
+			m_children[i]->m_diff += diffs[i];
+	}
+
+private:
+	template<typename T>
+	std::vector<T*> column_pointers(std::vector<T> &data) const
+	{
+		std::vector<T*> pointers(E::arity);
+		for(size_t k = 0; k < E::arity; ++k)
+			pointers[k] = data.data() + k * m_size;
+		return pointers;
+	}
+
+	std::vector<const double*> column_pointers(const std::vector<double> &data) const
+	{
+		std::vector<const double*> pointers(E::arity);
+		for(size_t k = 0; k < E::arity; ++k)
+			pointers[k] = data.data() + k * m_size;
+		return pointers;
+	}
+
+	E m_expression;
+	size_t m_size;
+	std::vector<double> m_columns;
+};
+
+// Declared next to the expression types so that argument dependent lookup finds them outside of CG
+template<typename L, typename R, typename = std::enable_if_t<are_operands<L, R>>>
+inline auto operator+(const L &left, const R &right)
+{
+	return Add<wrapped<L>, wrapped<R>>{wrap(left), wrap(right)};
+}
+
+template<typename L, typename R, typename = std::enable_if_t<are_operands<L, R>>>
+inline auto operator-(const L &left, const R &right)
+{
+	return Sub<wrapped<L>, wrapped<R>>{wrap(left), wrap(right)};
+}
+
+template<typename L, typename R, typename = std::enable_if_t<are_operands<L, R>>>
+inline auto operator*(const L &left, const R &right)
+{
+	return Mul<wrapped<L>, wrapped<R>>{wrap(left), wrap(right)};
+}
+
+template<typename E, typename = std::enable_if_t<is_expression<E>>>
+inline auto relu(const E &input)
+{
+	return Relu<wrapped<E>>{wrap(input)};
+}
+
+} // namespace expr
+
+using expr::operator+;
+using expr::operator-;
+using expr::operator*;
+using expr::relu;
+
+/**
+ * @brief Evaluates an elementwise expression, see CG::expr
+ * 
+ * @param expression 
+ * @return std::vector<Value> One node per element, all of them fed by a single segment node
+ */
+template<typename E, typename = std::enable_if_t<expr::is_expression<E>>>
+std::vector<Value> eval(const E &expression)
+{
+	auto wrapped = expr::wrap(expression);
+
+	std::vector<const std::vector<Value>*> operands;
+	wrapped.operands(operands);
+	assert(!operands.empty());
+
+	auto segment = std::make_shared<expr::ExprSegment<decltype(wrapped)>>(wrapped, operands, operands[0]->size());
+	return segment_outputs(segment, segment->evaluate());
+}
+
+} // namespace CG
\ No newline at end of file
@@ -1,46 +1,100 @@
 #include "dataset.hpp"
-#include "img_data.hpp"
+#include "idx.hpp"
 #include "utils.hpp"
-#include <string>
+#include <stdexcept>
 
-static std::vector<std::vector<double>> fetch_mnist_images(const std::string &path)
+static std::vector<std::vector<double>> fetch_idx_features(const std::string &path)
 {
-	auto images = load_images( path );
-	std::vector<std::vector<double>> converted_images;
+	auto tensor = IDX::load( path );
+	size_t sample_count = tensor.shape.empty() ? 0: tensor.shape[0];
+	size_t sample_size = tensor.sample_size();
+	double scale = tensor.dtype == IDX::DType::U8 ? 1.0 / 255.0: 1.0;
 
-	for(const auto &img: images)
-	{
-		converted_images.push_back(img.convert_to_01_vector());
-	}
+	std::vector<std::vector<double>> converted_features(sample_count, std::vector<double>(sample_size));
+
+	parallel_for(sample_count, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+		{
+			tensor.to_double(converted_features[i].data(), i * sample_size, sample_size, scale);
+		}
+	});
 
-	return converted_images;
+	return converted_features;
 }
 
-static std::vector<uint32_t> fetch_mnist_labels(const std::string &path)
+static std::vector<uint32_t> fetch_idx_labels(const std::string &path)
 {
-	auto labels = load_labels( path );
+	auto tensor = IDX::load( path );
+
+	if( tensor.shape.size() != 1 || tensor.dtype == IDX::DType::F32 || tensor.dtype == IDX::DType::F64 )
+	{
+		throw std::runtime_error("Expected a rank 1 integer tensor in " + path);
+	}
+
+	std::vector<double> labels(tensor.element_count());
+	tensor.to_double(labels.data(), 0, labels.size());
+
 	std::vector<uint32_t> converted_labels;
+	converted_labels.reserve(labels.size());
 
 	for(const auto &label: labels)
 	{
+		if( label < 0.0 )
+		{
+			throw std::runtime_error("Negative label in " + path);
+		}
+
 		converted_labels.push_back(static_cast<uint32_t>(label));
 	}
 
 	return converted_labels;
 }
 
-std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_mnist_digits_train()
+std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_idx_dataset(
+	const std::string &features_path,
+	const std::string &labels_path
+)
+{
+	auto dataset = std::make_pair(
+		fetch_idx_features(features_path),
+		fetch_idx_labels(labels_path)
+	);
+
+	if( dataset.first.size() != dataset.second.size() )
+	{
+		throw std::runtime_error("Sample count mismatch between " + features_path + " and " + labels_path);
+	}
+
+	return dataset;
+}
+
+std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_mnist_digits_train(const std::string &directory)
 {
-	return std::make_pair(
-		fetch_mnist_images("../dataset/train-images.idx3-ubyte"),
-		fetch_mnist_labels("../dataset/train-labels.idx1-ubyte")
+	return load_idx_dataset(
+		directory + "train-images.idx3-ubyte",
+		directory + "train-labels.idx1-ubyte"
 	);
 }
 
-std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_mnist_digits_test()
+std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_mnist_digits_test(const std::string &directory)
 {
-	return std::make_pair(
-		fetch_mnist_images("../dataset/t10k-images.idx3-ubyte"),
-		fetch_mnist_labels("../dataset/t10k-labels.idx1-ubyte")
+	return load_idx_dataset(
+		directory + "t10k-images.idx3-ubyte",
+		directory + "t10k-labels.idx1-ubyte"
 	);
+}
+
+std::vector<double> flatten_samples(const std::vector<std::vector<double>> &samples, size_t first, size_t count)
+{
+	std::vector<double> flat;
+	if(count == 0)
+		return flat;
+
+	flat.reserve(count * samples[first].size());
+	for(size_t i = first; i < first + count; ++i)
+	{
+		flat.insert(flat.end(), samples[i].begin(), samples[i].end());
+	}
+
+	return flat;
 }
\ No newline at end of file
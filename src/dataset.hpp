@@ -3,7 +3,31 @@
 #include <vector>
 #include <utility>
 #include <cstdint>
+#include <string>
 
-std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_mnist_digits_train();
+/**
+ * @brief Loads a (features, labels) pair from two IDX files of any type and rank. Each entry along
+ * the first dimension of the features file becomes one flattened sample, unsigned byte features are scaled to [0, 1]
+ * 
+ * @param features_path 
+ * @param labels_path Must hold a rank 1 tensor of integers
+ * @return std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> 
+ */
+std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_idx_dataset(
+	const std::string &features_path,
+	const std::string &labels_path
+);
 
-std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_mnist_digits_test();
\ No newline at end of file
+std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_mnist_digits_train(const std::string &directory = "../dataset/");
+
+std::pair<std::vector<std::vector<double>>, std::vector<uint32_t>> load_mnist_digits_test(const std::string &directory = "../dataset/");
+
+/**
+ * @brief Copies samples [first, first+count) one after the other, the batch layout used by NN::DenseNet
+ * 
+ * @param samples 
+ * @param first 
+ * @param count 
+ * @return std::vector<double> 
+ */
+std::vector<double> flatten_samples(const std::vector<std::vector<double>> &samples, size_t first, size_t count);
\ No newline at end of file
@@ -0,0 +1,380 @@
+#include "dense_net.hpp"
+#include "kernels.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+namespace NN
+{
+
+// Below this fraction of non zero output differentials, the LINEAR backward pass skips the dead units
+constexpr double sparse_backward_density = 0.5;
+
+DenseNet::DenseNet(const NeuralNet &network)
+{
+	const auto &architecture = network.architecture();
+	const auto &parameters = network.parameters();
+	assert(architecture.size() == parameters.size() && !architecture.empty());
+
+	size_t current_size = architecture.front().input_size;
+	for(size_t i = 0; i < architecture.size(); ++i)
+	{
+		DenseLayer dense_layer;
+		dense_layer.layer = architecture[i];
+		dense_layer.input_size = current_size;
+
+		switch(dense_layer.layer.operation)
+		{
+		case Layer::Func::LINEAR:
+		case Layer::Func::CONV2D:
+		case Layer::Func::MAXPOOL2D:
+			assert((size_t)dense_layer.layer.input_size == current_size);
+			dense_layer.output_size = dense_layer.layer.output_size;
+			break;
+		default:
+			dense_layer.output_size = current_size;
+			break;
+		}
+
+		dense_layer.weights_offset = m_parameters.size();
+		for(const auto &w: parameters[i].weights)
+			m_parameters.push_back(w->value());
+
+		dense_layer.biases_offset = m_parameters.size();
+		for(const auto &b: parameters[i].biases)
+			m_parameters.push_back(b->value());
+
+		current_size = dense_layer.output_size;
+		m_layers.push_back(dense_layer);
+	}
+}
+
+void DenseNet::store(NeuralNet &network) const
+{
+	const auto &parameters = network.parameters();
+	assert(parameters.size() == m_layers.size());
+
+	size_t index = 0;
+	for(const auto &layer_parameters: parameters)
+	{
+		for(const auto &w: layer_parameters.weights)
+			w->m_value = m_parameters[index++];
+
+		for(const auto &b: layer_parameters.biases)
+			b->m_value = m_parameters[index++];
+	}
+
+	assert(index == m_parameters.size());
+}
+
+void DenseNet::forward_layer(const DenseLayer &dense_layer, const double *input, size_t batch_size, double *output, uint32_t *argmax) const
+{
+	const Layer &layer = dense_layer.layer;
+	const double *weights = m_parameters.data() + dense_layer.weights_offset;
+	const double *biases = m_parameters.data() + dense_layer.biases_offset;
+	const size_t in_size = dense_layer.input_size;
+	const size_t out_size = dense_layer.output_size;
+
+	switch(layer.operation)
+	{
+	case Layer::Func::LINEAR:
+		// Y = X * W^T + b
+		for(size_t s = 0; s < batch_size; ++s)
+			std::copy(biases, biases + out_size, output + s * out_size);
+		gemm(batch_size, out_size, in_size, input, false, weights, true, output, true);
+		break;
+	case Layer::Func::CONV2D:
+		for(size_t s = 0; s < batch_size; ++s)
+			conv2d_forward(layer, weights, biases, input + s * in_size, output + s * out_size);
+		break;
+	case Layer::Func::MAXPOOL2D:
+		for(size_t s = 0; s < batch_size; ++s)
+			maxpool2d_forward(layer, input + s * in_size, output + s * out_size, argmax + s * out_size);
+		break;
+	case Layer::Func::RELU:
+		for(size_t i = 0; i < batch_size * out_size; ++i)
+			output[i] = input[i] > 0.0 ? input[i]: 0.0;
+		break;
+	case Layer::Func::SOFTMAX:
+		for(size_t s = 0; s < batch_size; ++s)
+			softmax_forward(input + s * in_size, in_size, output + s * out_size);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+void DenseNet::backward_layer(
+	const DenseLayer &dense_layer,
+	const double *input,
+	const double *output,
+	const uint32_t *argmax,
+	const double *output_diff,
+	size_t batch_size,
+	double *gradient,
+	double *input_diff
+) const
+{
+	const Layer &layer = dense_layer.layer;
+	const double *weights = m_parameters.data() + dense_layer.weights_offset;
+	double *weights_diff = gradient + dense_layer.weights_offset;
+	double *biases_diff = gradient + dense_layer.biases_offset;
+	const size_t in_size = dense_layer.input_size;
+	const size_t out_size = dense_layer.output_size;
+
+	switch(layer.operation)
+	{
+	case Layer::Func::LINEAR:
+	{
+		size_t live_count = 0;
+		for(size_t i = 0; i < batch_size * out_size; ++i)
+			live_count += output_diff[i] != 0.0;
+
+		if(live_count < sparse_backward_density * batch_size * out_size)
+		{
+			linear_backward_sparse(batch_size, in_size, out_size, input, weights, output_diff, weights_diff, biases_diff, input_diff);
+			break;
+		}
+
+		// dW += dY^T * X, db += sum of dY, dX = dY * W
+		gemm(out_size, in_size, batch_size, output_diff, true, input, false, weights_diff, true);
+		for(size_t s = 0; s < batch_size; ++s)
+		{
+			for(size_t o = 0; o < out_size; ++o)
+				biases_diff[o] += output_diff[s * out_size + o];
+		}
+		if(input_diff)
+			gemm(batch_size, in_size, out_size, output_diff, false, weights, false, input_diff, false);
+		break;
+	}
+	case Layer::Func::CONV2D:
+		for(size_t s = 0; s < batch_size; ++s)
+		{
+			conv2d_backward(
+				layer, weights, input + s * in_size, output_diff + s * out_size,
+				weights_diff, biases_diff, input_diff ? input_diff + s * in_size: nullptr
+			);
+		}
+		break;
+	case Layer::Func::MAXPOOL2D:
+		if(input_diff)
+		{
+			for(size_t s = 0; s < batch_size; ++s)
+				maxpool2d_backward(layer, argmax + s * out_size, output_diff + s * out_size, input_diff + s * in_size);
+		}
+		break;
+	case Layer::Func::RELU:
+		if(input_diff)
+		{
+			for(size_t i = 0; i < batch_size * out_size; ++i)
+				input_diff[i] = output[i] > 0.0 ? output_diff[i]: 0.0;
+		}
+		break;
+	case Layer::Func::SOFTMAX:
+		if(input_diff)
+		{
+			// dx_i = y_i * (dy_i - sum_j dy_j * y_j)
+			for(size_t s = 0; s < batch_size; ++s)
+			{
+				const double *y = output + s * out_size;
+				const double *dy = output_diff + s * out_size;
+
+				double dot = 0.0;
+				for(size_t i = 0; i < out_size; ++i)
+					dot += dy[i] * y[i];
+
+				for(size_t i = 0; i < out_size; ++i)
+					input_diff[s * in_size + i] = y[i] * (dy[i] - dot);
+			}
+		}
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+std::vector<double> DenseNet::forward(const double *inputs, size_t batch_size) const
+{
+	std::vector<double> current(inputs, inputs + batch_size * input_size());
+	std::vector<double> next;
+	std::vector<uint32_t> argmax;
+
+	for(const auto &dense_layer: m_layers)
+	{
+		next.resize(batch_size * dense_layer.output_size);
+		if(dense_layer.layer.operation == Layer::Func::MAXPOOL2D)
+			argmax.resize(next.size());
+
+		forward_layer(dense_layer, current.data(), batch_size, next.data(), argmax.data());
+		std::swap(current, next);
+	}
+
+	return current;
+}
+
+std::vector<std::vector<double>> DenseNet::forward_layers(const double *inputs, size_t batch_size) const
+{
+	std::vector<std::vector<uint32_t>> argmax;
+	return forward_layers(inputs, batch_size, argmax);
+}
+
+std::vector<std::vector<double>> DenseNet::forward_layers(const double *inputs, size_t batch_size, std::vector<std::vector<uint32_t>> &argmax) const
+{
+	std::vector<std::vector<double>> activations(m_layers.size() + 1);
+	argmax.assign(m_layers.size(), {});
+	activations[0].assign(inputs, inputs + batch_size * input_size());
+
+	for(size_t l = 0; l < m_layers.size(); ++l)
+	{
+		activations[l+1].resize(batch_size * m_layers[l].output_size);
+		if(m_layers[l].layer.operation == Layer::Func::MAXPOOL2D)
+			argmax[l].resize(activations[l+1].size());
+
+		forward_layer(m_layers[l], activations[l].data(), batch_size, activations[l+1].data(), argmax[l].data());
+	}
+
+	return activations;
+}
+
+double DenseNet::gradient(const double *inputs, const uint32_t *labels, size_t batch_size, double *gradient) const
+{
+	// Every activation is kept for the backward pass
+	std::vector<std::vector<uint32_t>> argmax;
+	auto activations = forward_layers(inputs, batch_size, argmax);
+
+	// Loss and its differential over the output
+	const size_t out_size = output_size();
+	const auto &output = activations.back();
+	std::vector<double> output_diff(output.size(), 0.0);
+	double loss = 0.0;
+
+	for(size_t s = 0; s < batch_size; ++s)
+	{
+		assert(labels[s] < out_size);
+		const double p = output[s * out_size + labels[s]] + CG::cross_entropy_epsilon;
+		loss -= log(p);
+		output_diff[s * out_size + labels[s]] = -1.0 / p;
+	}
+
+	backward_layers(activations, argmax, m_layers.size(), batch_size, output_diff, gradient);
+
+	return loss;
+}
+
+double DenseNet::distillation_gradient(
+	const double *inputs,
+	const uint32_t *labels,
+	const double *soft_targets,
+	double temperature,
+	double hard_weight,
+	size_t batch_size,
+	double *gradient
+) const
+{
+	assert(m_layers.back().layer.operation == Layer::Func::SOFTMAX);
+
+	std::vector<std::vector<uint32_t>> argmax;
+	auto activations = forward_layers(inputs, batch_size, argmax);
+
+	const size_t out_size = output_size();
+	const size_t softmax_layer = m_layers.size() - 1;
+	const auto &logits = activations[softmax_layer];
+	const auto &output = activations.back();
+
+	// The hard loss goes through the final softmax like in gradient()
+	std::vector<double> output_diff(output.size(), 0.0);
+	double hard_loss = 0.0;
+	for(size_t s = 0; s < batch_size; ++s)
+	{
+		assert(labels[s] < out_size);
+		const double p = output[s * out_size + labels[s]] + CG::cross_entropy_epsilon;
+		hard_loss -= log(p);
+		output_diff[s * out_size + labels[s]] = -hard_weight / p;
+	}
+
+	std::vector<double> logits_diff(logits.size());
+	backward_layer(
+		m_layers[softmax_layer], logits.data(), output.data(), nullptr,
+		output_diff.data(), batch_size, gradient, logits_diff.data()
+	);
+
+	// T^2 * cross entropy between the soft targets and softmax(z / T), its differential over z is T * (softmax(z / T) - q).
+	// The log of the softmax is computed directly, an epsilon would bias the gradient
+	std::vector<double> scaled(out_size);
+	double soft_loss = 0.0;
+	for(size_t s = 0; s < batch_size; ++s)
+	{
+		const double *z = logits.data() + s * out_size;
+		const double max_logit = *std::max_element(z, z + out_size);
+
+		double sum = 0.0;
+		for(size_t i = 0; i < out_size; ++i)
+		{
+			scaled[i] = (z[i] - max_logit) / temperature;
+			sum += exp(scaled[i]);
+		}
+
+		const double log_sum = log(sum);
+		for(size_t i = 0; i < out_size; ++i)
+		{
+			const double q = soft_targets[s * out_size + i];
+			const double log_softened = scaled[i] - log_sum;
+			soft_loss -= temperature * temperature * q * log_softened;
+			logits_diff[s * out_size + i] += (1.0 - hard_weight) * temperature * (exp(log_softened) - q);
+		}
+	}
+
+	backward_layers(activations, argmax, softmax_layer, batch_size, logits_diff, gradient);
+
+	return hard_weight * hard_loss + (1.0 - hard_weight) * soft_loss;
+}
+
+std::vector<double> DenseNet::logits(const double *inputs, size_t batch_size) const
+{
+	assert(m_layers.back().layer.operation == Layer::Func::SOFTMAX);
+
+	std::vector<double> current(inputs, inputs + batch_size * input_size());
+	std::vector<double> next;
+	std::vector<uint32_t> argmax;
+
+	for(size_t l = 0; l + 1 < m_layers.size(); ++l)
+	{
+		next.resize(batch_size * m_layers[l].output_size);
+		if(m_layers[l].layer.operation == Layer::Func::MAXPOOL2D)
+			argmax.resize(next.size());
+
+		forward_layer(m_layers[l], current.data(), batch_size, next.data(), argmax.data());
+		std::swap(current, next);
+	}
+
+	return current;
+}
+
+void DenseNet::backward_layers(
+	const std::vector<std::vector<double>> &activations,
+	const std::vector<std::vector<uint32_t>> &argmax,
+	size_t end,
+	size_t batch_size,
+	std::vector<double> &output_diff,
+	double *gradient
+) const
+{
+	std::vector<double> input_diff;
+	for(size_t l = end; l-- > 0;)
+	{
+		// The differential over the network input is never needed
+		input_diff.resize(l > 0 ? batch_size * m_layers[l].input_size: 0);
+
+		backward_layer(
+			m_layers[l], activations[l].data(), activations[l+1].data(), argmax[l].data(),
+			output_diff.data(), batch_size, gradient, l > 0 ? input_diff.data(): nullptr
+		);
+
+		std::swap(output_diff, input_diff);
+	}
+}
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "neural_network.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+/**
+ * @brief Snapshot of the parameters of a NeuralNet in one flat array, evaluated a whole batch
+ * at a time with the dense kernels instead of node by node through the compute graph
+ * 
+ */
+class DenseNet
+{
+public:
+	struct DenseLayer
+	{
+		Layer layer;
+
+		// Unlike in Layer, they are also set for RELU and SOFTMAX
+		size_t input_size;
+		size_t output_size;
+
+		// Position of the weights and biases in parameters()
+		size_t weights_offset;
+		size_t biases_offset;
+	};
+
+	/**
+	 * @brief Copies the current parameters of network
+	 * 
+	 * @param network 
+	 */
+	DenseNet(const NeuralNet &network);
+
+	inline size_t input_size() const { return m_layers.front().input_size; }
+
+	inline size_t output_size() const { return m_layers.back().output_size; }
+
+	inline size_t parameter_count() const { return m_parameters.size(); }
+
+	inline const std::vector<DenseLayer> &layers() const { return m_layers; }
+
+	// Parameters of each layer one after the other, the weights of a layer (same layout as LayerParameters) followed by its biases
+	inline std::vector<double> &parameters() { return m_parameters; }
+	inline const std::vector<double> &parameters() const { return m_parameters; }
+
+	/**
+	 * @brief Copies the parameters back into the leaves of network, which must have the same architecture
+	 * 
+	 * @param network 
+	 */
+	void store(NeuralNet &network) const;
+
+	/**
+	 * @brief Output of the network for a batch of inputs
+	 * 
+	 * @param inputs batch_size x input_size(), row-major
+	 * @param batch_size 
+	 * @return std::vector<double> batch_size x output_size(), row-major
+	 */
+	std::vector<double> forward(const double *inputs, size_t batch_size) const;
+
+	/**
+	 * @brief Every intermediate activation for a batch of inputs
+	 * 
+	 * @param inputs batch_size x input_size(), row-major
+	 * @param batch_size 
+	 * @return std::vector<std::vector<double>> The input followed by the output of each layer
+	 */
+	std::vector<std::vector<double>> forward_layers(const double *inputs, size_t batch_size) const;
+
+	/**
+	 * @brief Cross entropy over a batch, computed like CG::cross_entropy on the outputs. Thread safe
+	 * 
+	 * @param inputs batch_size x input_size(), row-major
+	 * @param labels 
+	 * @param batch_size 
+	 * @param gradient parameter_count() elements, the sum over the batch of the differential of the loss is added to it
+	 * @return double The sum of the losses of the batch
+	 */
+	double gradient(const double *inputs, const uint32_t *labels, size_t batch_size, double *gradient) const;
+
+	/**
+	 * @brief Distillation loss over a batch: hard_weight times the cross entropy with the labels, plus (1 - hard_weight)
+	 * times the cross entropy between soft_targets and the softmax of the logits divided by temperature, scaled by
+	 * temperature^2 so that its gradient keeps the same magnitude whatever the temperature. The last layer must be a
+	 * SOFTMAX. Thread safe
+	 * 
+	 * @param inputs batch_size x input_size(), row-major
+	 * @param labels 
+	 * @param soft_targets batch_size x output_size(), the teacher's probabilities at the same temperature
+	 * @param temperature 
+	 * @param hard_weight 
+	 * @param batch_size 
+	 * @param gradient parameter_count() elements, the sum over the batch of the differential of the loss is added to it
+	 * @return double The sum of the losses of the batch
+	 */
+	double distillation_gradient(
+		const double *inputs,
+		const uint32_t *labels,
+		const double *soft_targets,
+		double temperature,
+		double hard_weight,
+		size_t batch_size,
+		double *gradient
+	) const;
+
+	/**
+	 * @brief Input of the final SOFTMAX layer for a batch of inputs
+	 * 
+	 * @param inputs batch_size x input_size(), row-major
+	 * @param batch_size 
+	 * @return std::vector<double> batch_size x output_size(), row-major
+	 */
+	std::vector<double> logits(const double *inputs, size_t batch_size) const;
+
+	friend class PipelinedNet;
+private:
+
+	// Backward pass through the layers before end, output_diff being the differential over the output of layer end-1
+	void backward_layers(
+		const std::vector<std::vector<double>> &activations,
+		const std::vector<std::vector<uint32_t>> &argmax,
+		size_t end,
+		size_t batch_size,
+		std::vector<double> &output_diff,
+		double *gradient
+	) const;
+
+	std::vector<std::vector<double>> forward_layers(const double *inputs, size_t batch_size, std::vector<std::vector<uint32_t>> &argmax) const;
+
+	void forward_layer(const DenseLayer &dense_layer, const double *input, size_t batch_size, double *output, uint32_t *argmax) const;
+
+	void backward_layer(
+		const DenseLayer &dense_layer,
+		const double *input,
+		const double *output,
+		const uint32_t *argmax,
+		const double *output_diff,
+		size_t batch_size,
+		double *gradient,
+		double *input_diff
+	) const;
+
+	std::vector<DenseLayer> m_layers;
+	std::vector<double> m_parameters;
+};
+
+} // namespace NN
\ No newline at end of file
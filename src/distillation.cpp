@@ -0,0 +1,81 @@
+#include "distillation.hpp"
+#include "kernels.hpp"
+#include "utils.hpp"
+
+#include <cassert>
+#include <algorithm>
+
+namespace NN
+{
+
+// Samples evaluated together by soft_targets, bounds the memory used by the activations
+constexpr size_t soft_target_batch_size = 1000;
+
+std::vector<double> soft_targets(const DenseNet &teacher, const double *inputs, size_t sample_count, double temperature)
+{
+	const size_t in_size = teacher.input_size();
+	const size_t out_size = teacher.output_size();
+	std::vector<double> targets(sample_count * out_size);
+
+	for(size_t first = 0; first < sample_count; first += soft_target_batch_size)
+	{
+		size_t batch_size = std::min(soft_target_batch_size, sample_count - first);
+		auto logits = teacher.logits(inputs + first * in_size, batch_size);
+
+		for(auto &logit: logits)
+			logit /= temperature;
+
+		for(size_t s = 0; s < batch_size; ++s)
+			softmax_forward(logits.data() + s * out_size, out_size, targets.data() + (first + s) * out_size);
+	}
+
+	return targets;
+}
+
+void distill(
+	DenseNet &student,
+	const double *inputs,
+	const uint32_t *labels,
+	const double *targets,
+	size_t sample_count,
+	const DistillationSettings &settings
+)
+{
+	const size_t in_size = student.input_size();
+	const size_t out_size = student.output_size();
+	auto &parameters = student.parameters();
+
+	std::vector<double> gradient(parameters.size());
+	std::vector<double> velocity(parameters.size(), 0.0);
+
+	std::vector<double> batch_inputs(settings.batch_size * in_size);
+	std::vector<uint32_t> batch_labels(settings.batch_size);
+	std::vector<double> batch_targets(settings.batch_size * out_size);
+
+	auto permutation = generate_permutation(sample_count);
+
+	for(int step = 0; step < settings.steps; ++step)
+	{
+		for(size_t i = 0; i < settings.batch_size; ++i)
+		{
+			size_t index = permutation[(step * settings.batch_size + i) % sample_count];
+			std::copy(inputs + index * in_size, inputs + (index + 1) * in_size, batch_inputs.begin() + i * in_size);
+			std::copy(targets + index * out_size, targets + (index + 1) * out_size, batch_targets.begin() + i * out_size);
+			batch_labels[i] = labels[index];
+		}
+
+		std::fill(gradient.begin(), gradient.end(), 0.0);
+		student.distillation_gradient(
+			batch_inputs.data(), batch_labels.data(), batch_targets.data(),
+			settings.temperature, settings.hard_weight, settings.batch_size, gradient.data()
+		);
+
+		for(size_t i = 0; i < parameters.size(); ++i)
+		{
+			velocity[i] = settings.momentum * velocity[i] + gradient[i] / (double)settings.batch_size;
+			parameters[i] -= settings.learning_rate * velocity[i];
+		}
+	}
+}
+
+} // namespace NN
\ No newline at end of file
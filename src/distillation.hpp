@@ -0,0 +1,59 @@
+#pragma once
+
+#include "dense_net.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+struct DistillationSettings
+{
+	// Softens the teacher's probabilities, so that the student also learns which wrong classes are close
+	double temperature = 4.0;
+
+	// Weight of the cross entropy with the labels, the soft cross entropy gets 1 - hard_weight
+	double hard_weight = 0.1;
+
+	int steps = 2000;
+	size_t batch_size = 64;
+
+	// The differential of the soft loss grows with the temperature, so the rate is lower than for the hard loss alone
+	double learning_rate = 0.01;
+	double momentum = 0.9;
+};
+
+/**
+ * @brief Probabilities of the teacher at the given temperature, softmax(logits / temperature), computed in batches
+ * 
+ * @param teacher Its last layer must be a SOFTMAX
+ * @param inputs sample_count x input size, row-major
+ * @param sample_count 
+ * @param temperature 
+ * @return std::vector<double> sample_count x output size, row-major
+ */
+std::vector<double> soft_targets(const DenseNet &teacher, const double *inputs, size_t sample_count, double temperature);
+
+/**
+ * @brief Trains student with momentum SGD on DenseNet::distillation_gradient, drawing its batches from a
+ * random permutation of the samples
+ * 
+ * @param student Its last layer must be a SOFTMAX
+ * @param inputs sample_count x input size, row-major
+ * @param labels 
+ * @param targets Given by soft_targets at settings.temperature
+ * @param sample_count 
+ * @param settings 
+ */
+void distill(
+	DenseNet &student,
+	const double *inputs,
+	const uint32_t *labels,
+	const double *targets,
+	size_t sample_count,
+	const DistillationSettings &settings = DistillationSettings()
+);
+
+} // namespace NN
\ No newline at end of file
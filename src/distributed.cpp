@@ -0,0 +1,338 @@
+#include "distributed.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#define DISTRIBUTED_POSIX 1
+#else
+#define DISTRIBUTED_POSIX 0
+#endif
+
+namespace NN
+{
+
+#if DISTRIBUTED_POSIX
+
+// The next process may not listen yet when we connect
+constexpr int connect_attempts = 3000;
+constexpr auto connect_retry_delay = std::chrono::milliseconds(10);
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#else
+constexpr int send_flags = MSG_DONTWAIT;
+#endif
+
+static std::vector<pid_t> workers;
+
+static int listen_on(uint16_t port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0)
+		throw std::runtime_error("Cannot create a socket");
+
+	int enable = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+	sockaddr_in address {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 1) != 0)
+	{
+		close(fd);
+		throw std::runtime_error("Cannot listen on port " + std::to_string(port));
+	}
+
+	return fd;
+}
+
+static int connect_to(const std::string &host, uint16_t port)
+{
+	addrinfo hints {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo *addresses = nullptr;
+	if(getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0 || !addresses)
+		throw std::runtime_error("Cannot resolve " + host);
+
+	int fd = -1;
+	for(int attempt = 0; attempt < connect_attempts && fd < 0; ++attempt)
+	{
+		fd = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+		if(fd >= 0 && connect(fd, addresses->ai_addr, addresses->ai_addrlen) != 0)
+		{
+			close(fd);
+			fd = -1;
+			std::this_thread::sleep_for(connect_retry_delay);
+		}
+	}
+
+	freeaddrinfo(addresses);
+
+	if(fd < 0)
+		throw std::runtime_error("Cannot connect to " + host + ":" + std::to_string(port));
+
+	return fd;
+}
+
+RingAllReduce::RingAllReduce(int rank, int world_size, const std::string &next_host, uint16_t base_port):
+	m_rank(rank),
+	m_world_size(world_size)
+{
+	if(world_size < 1 || rank < 0 || rank >= world_size)
+		throw std::runtime_error("Invalid rank " + std::to_string(rank) + " for " + std::to_string(world_size) + " processes");
+
+	if(world_size == 1)
+		return;
+
+	// Everyone listens before connecting, the connections complete in the backlog before being accepted
+	int listen_fd = listen_on(base_port + rank);
+	m_next = connect_to(next_host, base_port + (rank + 1) % world_size);
+	m_previous = accept(listen_fd, nullptr, nullptr);
+	close(listen_fd);
+
+	if(m_previous < 0)
+		throw std::runtime_error("Cannot accept the previous process");
+
+	// The chunks are sent as soon as they are ready
+	int enable = 1;
+	setsockopt(m_next, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	setsockopt(m_previous, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+}
+
+RingAllReduce::~RingAllReduce()
+{
+	if(m_next >= 0)
+		close(m_next);
+	if(m_previous >= 0)
+		close(m_previous);
+}
+
+void RingAllReduce::exchange(const void *send_data, size_t send_size, void *recv_data, size_t recv_size)
+{
+	// With blocking calls every process could wait in send for its successor, itself waiting in send
+	auto send_bytes = static_cast<const char*>(send_data);
+	auto recv_bytes = static_cast<char*>(recv_data);
+
+	while(send_size > 0 || recv_size > 0)
+	{
+		pollfd fds[2];
+		nfds_t fd_count = 0;
+		if(send_size > 0)
+			fds[fd_count++] = {m_next, POLLOUT, 0};
+		if(recv_size > 0)
+			fds[fd_count++] = {m_previous, POLLIN, 0};
+
+		if(poll(fds, fd_count, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw std::runtime_error("Ring all-reduce: poll failed");
+		}
+
+		if(send_size > 0)
+		{
+			ssize_t sent = send(m_next, send_bytes, send_size, send_flags);
+			if(sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				throw std::runtime_error("Ring all-reduce: the next process disconnected");
+
+			if(sent > 0)
+			{
+				send_bytes += sent;
+				send_size -= sent;
+			}
+		}
+
+		if(recv_size > 0)
+		{
+			ssize_t received = recv(m_previous, recv_bytes, recv_size, MSG_DONTWAIT);
+			if(received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+				throw std::runtime_error("Ring all-reduce: the previous process disconnected");
+
+			if(received > 0)
+			{
+				recv_bytes += received;
+				recv_size -= received;
+			}
+		}
+	}
+}
+
+void RingAllReduce::sum(double *data, size_t count)
+{
+	const size_t n = m_world_size;
+	if(n == 1)
+		return;
+
+	auto chunk_begin = [&](size_t chunk) { return chunk * count / n; };
+	auto chunk_size = [&](size_t chunk) { return chunk_begin(chunk + 1) - chunk_begin(chunk); };
+
+	m_incoming.resize(count / n + 1);
+
+	// Reduce-scatter: at step s, chunk (rank-s) goes to the next process, which adds it to its own.
+	// Afterwards, this process holds the complete sum of chunk (rank+1)
+	for(size_t step = 0; step + 1 < n; ++step)
+	{
+		size_t send_chunk = (m_rank + n - step) % n;
+		size_t recv_chunk = (m_rank + n - step - 1) % n;
+
+		exchange(
+			data + chunk_begin(send_chunk), chunk_size(send_chunk) * sizeof(double),
+			m_incoming.data(), chunk_size(recv_chunk) * sizeof(double)
+		);
+
+		double *target = data + chunk_begin(recv_chunk);
+		for(size_t i = 0; i < chunk_size(recv_chunk); ++i)
+			target[i] += m_incoming[i];
+	}
+
+	// All-gather: the complete chunks go around the ring, copied as they are
+	for(size_t step = 0; step + 1 < n; ++step)
+	{
+		size_t send_chunk = (m_rank + n + 1 - step) % n;
+		size_t recv_chunk = (m_rank + n - step) % n;
+
+		exchange(
+			data + chunk_begin(send_chunk), chunk_size(send_chunk) * sizeof(double),
+			data + chunk_begin(recv_chunk), chunk_size(recv_chunk) * sizeof(double)
+		);
+	}
+}
+
+int fork_workers(int world_size)
+{
+	// Otherwise the buffered output would be printed again by every worker
+	std::cout.flush();
+	std::fflush(nullptr);
+
+	for(int rank = 1; rank < world_size; ++rank)
+	{
+		pid_t pid = fork();
+		if(pid < 0)
+			throw std::runtime_error("Cannot fork worker " + std::to_string(rank));
+
+		if(pid == 0)
+		{
+			workers.clear();
+			return rank;
+		}
+
+		workers.push_back(pid);
+	}
+
+	return 0;
+}
+
+bool wait_workers()
+{
+	bool success = true;
+	for(auto pid: workers)
+	{
+		int status = 0;
+		if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			success = false;
+	}
+
+	workers.clear();
+	return success;
+}
+
+#else
+
+RingAllReduce::RingAllReduce(int rank, int world_size, const std::string &, uint16_t):
+	m_rank(rank),
+	m_world_size(world_size)
+{
+	if(world_size != 1)
+		throw std::runtime_error("Multi-process training needs POSIX sockets");
+}
+
+RingAllReduce::~RingAllReduce()
+{
+}
+
+void RingAllReduce::exchange(const void*, size_t, void*, size_t)
+{
+}
+
+void RingAllReduce::sum(double*, size_t)
+{
+}
+
+int fork_workers(int world_size)
+{
+	if(world_size != 1)
+		throw std::runtime_error("Multi-process training needs fork");
+
+	return 0;
+}
+
+bool wait_workers()
+{
+	return true;
+}
+
+#endif
+
+// Every parameter leaf of the network, in the same order in every process
+static std::vector<CG::Value> parameter_leaves(const NeuralNet &network)
+{
+	std::vector<CG::Value> leaves;
+	for(const auto &layer_parameters: network.parameters())
+	{
+		leaves.insert(leaves.end(), layer_parameters.weights.begin(), layer_parameters.weights.end());
+		leaves.insert(leaves.end(), layer_parameters.biases.begin(), layer_parameters.biases.end());
+	}
+
+	return leaves;
+}
+
+void average_gradients(const NeuralNet &network, RingAllReduce &ring)
+{
+	auto leaves = parameter_leaves(network);
+
+	std::vector<double> gradient(leaves.size());
+	for(size_t i = 0; i < leaves.size(); ++i)
+		gradient[i] = leaves[i]->m_diff;
+
+	ring.sum(gradient.data(), gradient.size());
+
+	for(size_t i = 0; i < leaves.size(); ++i)
+		leaves[i]->m_diff = gradient[i] / ring.world_size();
+}
+
+void broadcast_parameters(const NeuralNet &network, RingAllReduce &ring)
+{
+	auto leaves = parameter_leaves(network);
+
+	// A sum where every other process contributes zeros
+	std::vector<double> values(leaves.size(), 0.0);
+	if(ring.rank() == 0)
+	{
+		for(size_t i = 0; i < leaves.size(); ++i)
+			values[i] = leaves[i]->m_value;
+	}
+
+	ring.sum(values.data(), values.size());
+
+	for(size_t i = 0; i < leaves.size(); ++i)
+		leaves[i]->m_value = values[i];
+}
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "neural_network.hpp"
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+/**
+ * @brief Connects the processes of a data parallel training in a ring over TCP: each process sends to the next
+ * one and receives from the previous one. Only available on POSIX systems
+ *
+ */
+class RingAllReduce
+{
+public:
+	/**
+	 * @brief Listens on base_port + rank and connects to the next process, blocks until both connections are made
+	 *
+	 * @param rank Position of this process in the ring, in [0, world_size)
+	 * @param world_size Number of processes
+	 * @param next_host Address of the process of rank (rank+1) % world_size
+	 * @param base_port
+	 */
+	RingAllReduce(int rank, int world_size, const std::string &next_host = "127.0.0.1", uint16_t base_port = 29500);
+
+	~RingAllReduce();
+
+	RingAllReduce(const RingAllReduce&) = delete;
+	RingAllReduce &operator=(const RingAllReduce&) = delete;
+
+	inline int rank() const { return m_rank; }
+
+	inline int world_size() const { return m_world_size; }
+
+	/**
+	 * @brief Replaces data by its sum over every process, which must all call it with the same count.
+	 * Reduce-scatter then all-gather: each process sends and receives 2*(world_size-1)/world_size*count
+	 * elements whatever the number of processes, and every process ends with the same bits
+	 *
+	 * @param data
+	 * @param count
+	 */
+	void sum(double *data, size_t count);
+
+private:
+	// Sends to the next process while receiving from the previous one
+	void exchange(const void *send_data, size_t send_size, void *recv_data, size_t recv_size);
+
+	int m_rank;
+	int m_world_size;
+	int m_next {-1};
+	int m_previous {-1};
+	std::vector<double> m_incoming;
+};
+
+// Averages the differentials of the network's parameters over every process, to call before Optimizer::step
+void average_gradients(const NeuralNet &network, RingAllReduce &ring);
+
+// Copies the parameters of the process of rank 0 to every other one
+void broadcast_parameters(const NeuralNet &network, RingAllReduce &ring);
+
+/**
+ * @brief Forks world_size-1 worker processes, which share the memory of the caller until they write to it
+ *
+ * @param world_size
+ * @return int The rank of the calling process: 0 for the parent, 1 to world_size-1 for the workers
+ */
+int fork_workers(int world_size);
+
+// Called by the parent after fork_workers, returns true if every worker exited normally
+bool wait_workers();
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "evaluator.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <chrono>
+#include <algorithm>
+
+namespace NN
+{
+
+// Samples evaluated together, bounds the memory used by the activations
+constexpr size_t evaluation_batch_size = 1000;
+
+BackgroundEvaluator::BackgroundEvaluator(const NeuralNet &network, std::vector<double> inputs, std::vector<uint32_t> labels):
+	m_network(network),
+	m_inputs(std::move(inputs)),
+	m_labels(std::move(labels)),
+	m_staging(network),
+	m_pending(network),
+	m_evaluating(network)
+{
+	assert(m_inputs.size() == m_labels.size() * m_staging.input_size());
+
+	m_thread = std::thread(&BackgroundEvaluator::worker, this);
+}
+
+BackgroundEvaluator::~BackgroundEvaluator()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+void BackgroundEvaluator::snapshot(size_t step)
+{
+	// Same order as the DenseNet constructor
+	auto value = m_staging.parameters().begin();
+	for(const auto &layer_parameters: m_network.parameters())
+	{
+		for(const auto &w: layer_parameters.weights)
+			*value++ = w->m_value;
+
+		for(const auto &b: layer_parameters.biases)
+			*value++ = b->m_value;
+	}
+
+	m_staging_step = step;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::swap(m_staging, m_pending);
+		std::swap(m_staging_step, m_pending_step);
+
+		if(m_has_pending)
+			++m_skipped;
+		m_has_pending = true;
+	}
+
+	m_cv.notify_all();
+}
+
+void BackgroundEvaluator::flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv.wait(lock, [this]() { return !m_has_pending && !m_busy; });
+}
+
+std::vector<Evaluation> BackgroundEvaluator::results()
+{
+	std::vector<Evaluation> results;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::swap(results, m_results);
+	return results;
+}
+
+size_t BackgroundEvaluator::skipped()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_skipped;
+}
+
+void BackgroundEvaluator::worker()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for(;;)
+	{
+		m_cv.wait(lock, [this]() { return m_has_pending || m_stop; });
+
+		// The pending snapshot is still evaluated when stopping
+		if(!m_has_pending)
+			return;
+
+		std::swap(m_pending, m_evaluating);
+		size_t step = m_pending_step;
+		m_has_pending = false;
+		m_busy = true;
+
+		lock.unlock();
+		Evaluation evaluation = evaluate(m_evaluating);
+		evaluation.step = step;
+		lock.lock();
+
+		m_results.push_back(evaluation);
+		m_busy = false;
+		m_cv.notify_all();
+	}
+}
+
+Evaluation BackgroundEvaluator::evaluate(const DenseNet &network) const
+{
+	auto start = std::chrono::steady_clock::now();
+
+	const size_t input_size = network.input_size();
+	const size_t output_size = network.output_size();
+
+	Evaluation evaluation;
+	double correct_guess = 0.0;
+
+	for(size_t first = 0; first < m_labels.size(); first += evaluation_batch_size)
+	{
+		size_t batch_size = std::min(evaluation_batch_size, m_labels.size() - first);
+		auto outputs = network.forward(m_inputs.data() + first * input_size, batch_size);
+
+		for(size_t i = 0; i < batch_size; ++i)
+		{
+			auto output = outputs.begin() + i * output_size;
+			uint32_t label = m_labels[first + i];
+
+			if(std::max_element(output, output + output_size) - output == label)
+				correct_guess += 1.0;
+
+			evaluation.mean_loss -= std::log(output[label] + CG::cross_entropy_epsilon);
+		}
+	}
+
+	evaluation.mean_loss /= (double)m_labels.size();
+	evaluation.accuracy = correct_guess / (double)m_labels.size();
+	evaluation.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return evaluation;
+}
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "neural_network.hpp"
+#include "dense_net.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+struct Evaluation
+{
+	// Given to BackgroundEvaluator::snapshot
+	size_t step = 0;
+
+	double mean_loss = 0.0;
+	double accuracy = 0.0;
+
+	// Time taken by the evaluation thread
+	double seconds = 0.0;
+};
+
+/**
+ * @brief Evaluates a network on a test set without blocking the training thread: snapshot() only copies the
+ * parameters into a staging DenseNet, a background thread evaluates it while the training goes on.
+ * Like CheckpointWriter, a snapshot taken while the previous one is still waiting replaces it
+ *
+ */
+class BackgroundEvaluator
+{
+public:
+	/**
+	 * @brief Starts the evaluation thread
+	 *
+	 * @param network Must outlive the evaluator, its architecture can't change
+	 * @param inputs labels.size() x input size, row-major
+	 * @param labels
+	 */
+	BackgroundEvaluator(const NeuralNet &network, std::vector<double> inputs, std::vector<uint32_t> labels);
+
+	// Evaluates the last snapshot if it is still pending
+	~BackgroundEvaluator();
+
+	BackgroundEvaluator(const BackgroundEvaluator&) = delete;
+	BackgroundEvaluator &operator=(const BackgroundEvaluator&) = delete;
+
+	/**
+	 * @brief Copies the current parameters, to be called between two optimizer steps
+	 *
+	 * @param step Identifies the snapshot in its Evaluation
+	 */
+	void snapshot(size_t step);
+
+	// Blocks until the last snapshot is evaluated
+	void flush();
+
+	// Evaluations finished since the last call, oldest first
+	std::vector<Evaluation> results();
+
+	// Number of snapshots replaced before being evaluated
+	size_t skipped();
+
+private:
+	void worker();
+
+	Evaluation evaluate(const DenseNet &network) const;
+
+	const NeuralNet &m_network;
+	std::vector<double> m_inputs;
+	std::vector<uint32_t> m_labels;
+
+	// Filled by snapshot(), then swapped with m_pending which the worker swaps with m_evaluating:
+	// the lock is only held for the swaps
+	DenseNet m_staging;
+	DenseNet m_pending;
+	DenseNet m_evaluating;
+	size_t m_staging_step = 0;
+	size_t m_pending_step = 0;
+
+	std::vector<Evaluation> m_results;
+	size_t m_skipped = 0;
+
+	bool m_has_pending = false;
+	bool m_busy = false;
+	bool m_stop = false;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+};
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "graph_opt.hpp"
+#include "utils.hpp"
+
+#include <unordered_map>
+#include <cassert>
+
+namespace CG
+{
+
+static bool is_constant(const Value &node)
+{
+	return node->m_op == Op::LEAF && node->m_constant;
+}
+
+static Value make_node(Op op, std::vector<Value> children, uint32_t input_index)
+{
+	auto ptr = std::make_shared<CG>(0.0);
+
+	ptr->m_op = op;
+	ptr->m_children = std::move(children);
+	ptr->m_input_index = input_index;
+	ptr->forward();
+
+	return ptr;
+}
+
+std::vector<Value> optimize(const std::vector<Value> &outputs, OptimizeStats *stats)
+{
+	OptimizeStats local_stats;
+	auto order = topological_sort(outputs);
+	local_stats.nodes_before = order.size();
+
+	// How many times each node is used as a child, or returned as an output.
+	// A node used once can be merged into its only user
+	std::unordered_map<const CG*, size_t> use_count;
+	for(const auto &node: order)
+	{
+		for(const auto &child: node->m_children)
+			++use_count[child.get()];
+	}
+	for(const auto &node: outputs)
+		++use_count[node.get()];
+
+	// Rewritten version of every visited node, children are visited before their users
+	std::unordered_map<const CG*, Value> rewritten;
+	for(auto it = order.rbegin(); it != order.rend(); ++it)
+	{
+		const Value &node = *it;
+
+		// Segments reference their own children, they are kept as they are
+		if(node->m_op == Op::LEAF || node->m_op == Op::SEGMENT || node->m_op == Op::SEGMENT_OUTPUT)
+		{
+			rewritten[node.get()] = node;
+			continue;
+		}
+
+		std::vector<Value> children;
+		children.reserve(node->m_children.size());
+		bool all_constant = true;
+		for(const auto &child: node->m_children)
+		{
+			children.push_back(rewritten.at(child.get()));
+			all_constant = all_constant && is_constant(children.back());
+		}
+
+		Value result;
+
+		if(all_constant)
+		{
+			result = constant(make_node(node->m_op, children, node->m_input_index)->value());
+			++local_stats.folded;
+		}
+		else if(node->m_op == Op::MUL && ((is_constant(children[0]) && children[0]->value() == 0.0) ||
+			(is_constant(children[1]) && children[1]->value() == 0.0)))
+		{
+			// Always 0, and the differential it sends to its other operand is 0 too
+			result = constant(0.0);
+			++local_stats.folded;
+		}
+		else if(node->m_op == Op::ADD || node->m_op == Op::DOT)
+		{
+			// Split the operands into plain addends and products
+			size_t addend_count = node->m_op == Op::ADD ? children.size(): node->m_input_index;
+			std::vector<Value> addends;
+			std::vector<Value> products(children.begin() + addend_count, children.end());
+
+			for(size_t i = 0; i < addend_count; ++i)
+			{
+				const Value &child = children[i];
+
+				if(is_constant(child) && child->value() == 0.0)
+				{
+					++local_stats.eliminated;
+				}
+				else if(child->m_op == Op::MUL && use_count[node->m_children[i].get()] == 1)
+				{
+					products.push_back(child->m_children[0]);
+					products.push_back(child->m_children[1]);
+					++local_stats.fused;
+				}
+				else
+				{
+					addends.push_back(child);
+				}
+			}
+
+			if(products.empty() && addends.size() == 1)
+				result = addends[0];
+			else if(products.empty() && addends.empty())
+				result = constant(0.0);
+			else if(products.empty())
+				result = make_node(Op::ADD, addends, 0);
+			else
+			{
+				uint32_t input_index = addends.size();
+				addends.insert(addends.end(), products.begin(), products.end());
+				result = make_node(Op::DOT, addends, input_index);
+			}
+		}
+		else if(node->m_op == Op::RELU && children[0]->m_op == Op::DOT && use_count[node->m_children[0].get()] == 1)
+		{
+			result = make_node(Op::DOT_RELU, children[0]->m_children, children[0]->m_input_index);
+			++local_stats.fused;
+		}
+		else
+		{
+			result = make_node(node->m_op, children, node->m_input_index);
+		}
+
+		rewritten[node.get()] = result;
+	}
+
+	std::vector<Value> optimized;
+	optimized.reserve(outputs.size());
+	for(const auto &node: outputs)
+		optimized.push_back(rewritten.at(node.get()));
+
+	// Everything only referenced by the map is released here
+	rewritten.clear();
+	local_stats.nodes_after = topological_sort(optimized).size();
+
+	if(stats)
+		*stats = local_stats;
+
+	return optimized;
+}
+
+} // namespace CG
\ No newline at end of file
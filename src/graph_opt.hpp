@@ -0,0 +1,45 @@
+#pragma once
+
+#include "compute_graph.hpp"
+
+#include <vector>
+#include <cstddef>
+
+namespace CG
+{
+
+/**
+ * @brief What CG::optimize did to a graph
+ * 
+ */
+struct OptimizeStats
+{
+	size_t nodes_before = 0;
+	size_t nodes_after = 0;
+
+	// MUL chains merged into a DOT, and DOT + RELU merged into a DOT_RELU
+	size_t fused = 0;
+
+	// Nodes replaced by a constant
+	size_t folded = 0;
+
+	// Operands removed because they can't change the value (constant zero addends)
+	size_t eliminated = 0;
+};
+
+/**
+ * @brief Rewrites the graph computing outputs into an equivalent one with fewer nodes:
+ * - MUL nodes only used by an ADD are fused into a single DOT node, and a RELU over a DOT into a DOT_RELU
+ * - nodes whose children are all constant (see CG::constant) are folded into a constant
+ * - constant zero addends are dropped, and nodes that no longer reach an output are released
+ * 
+ * The original graph is left untouched. Non constant leaves are shared by both graphs, so inputs
+ * set on them and differentials accumulated by backprop are seen through either one
+ * 
+ * @param outputs 
+ * @param stats If not null, filled with what the pass did
+ * @return std::vector<Value> The outputs of the optimized graph, in the same order
+ */
+std::vector<Value> optimize(const std::vector<Value> &outputs, OptimizeStats *stats = nullptr);
+
+} // namespace CG
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "idx.hpp"
+#include "utils.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+
+namespace IDX
+{
+
+// Below this size, spawning threads costs more than decoding the file
+constexpr size_t parallel_threshold = 1 << 20;
+
+static bool host_is_little_endian()
+{
+	const uint16_t probe = 1;
+	return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+}
+
+static bool valid_dtype(uint8_t code)
+{
+	switch(static_cast<DType>(code))
+	{
+	case DType::U8: case DType::I8: case DType::I16:
+	case DType::I32: case DType::F32: case DType::F64:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void byte_swap(uint8_t *data, size_t count, size_t element_size)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		std::reverse(data + i * element_size, data + (i+1) * element_size);
+	}
+}
+
+size_t dtype_size(DType dtype)
+{
+	switch(dtype)
+	{
+	case DType::U8: case DType::I8:
+		return 1;
+	case DType::I16:
+		return 2;
+	case DType::I32: case DType::F32:
+		return 4;
+	case DType::F64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+size_t Tensor::element_count() const
+{
+	size_t count = 1;
+	for(auto dim: shape)
+		count *= dim;
+
+	return shape.empty() ? 0: count;
+}
+
+size_t Tensor::sample_size() const
+{
+	if(shape.empty() || shape[0] == 0)
+		return 0;
+
+	return element_count() / shape[0];
+}
+
+template<typename T>
+static void convert(const T *src, double *out, size_t count, double scale)
+{
+	for(size_t i = 0; i < count; ++i)
+		out[i] = static_cast<double>(src[i]) * scale;
+}
+
+void Tensor::to_double(double *out, size_t first, size_t count, double scale) const
+{
+	switch(dtype)
+	{
+	case DType::U8:  convert(as<uint8_t>() + first, out, count, scale); break;
+	case DType::I8:  convert(as<int8_t>() + first, out, count, scale); break;
+	case DType::I16: convert(as<int16_t>() + first, out, count, scale); break;
+	case DType::I32: convert(as<int32_t>() + first, out, count, scale); break;
+	case DType::F32: convert(as<float>() + first, out, count, scale); break;
+	case DType::F64: convert(as<double>() + first, out, count, scale); break;
+	}
+}
+
+Tensor load(const std::string &file_path, unsigned thread_count)
+{
+	std::ifstream file {file_path, std::ios::in | std::ios::binary};
+
+	if( !file )
+	{
+		throw std::runtime_error("Cannot open " + file_path);
+	}
+
+	// Magic number: two zero bytes, the type code and the rank
+	uint8_t magic[4] = {0, 0, 0, 0};
+	file.read( (char*)magic, 4 );
+
+	if( file.fail() || magic[0] != 0 || magic[1] != 0 || !valid_dtype(magic[2]) )
+	{
+		throw std::runtime_error("Invalid IDX header in " + file_path);
+	}
+
+	Tensor tensor;
+	tensor.dtype = static_cast<DType>(magic[2]);
+	tensor.shape.resize(magic[3]);
+
+	// Dimensions are stored as big endian uint32
+	for(auto &dim: tensor.shape)
+	{
+		uint8_t bytes[4] = {0, 0, 0, 0};
+		file.read( (char*)bytes, 4 );
+		dim = (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+	}
+
+	if( file.fail() )
+	{
+		throw std::runtime_error("Truncated IDX header in " + file_path);
+	}
+
+	const size_t header_size = 4 + 4 * tensor.shape.size();
+	const size_t element_size = dtype_size(tensor.dtype);
+	const bool swap = element_size > 1 && host_is_little_endian();
+
+	// The dimensions are checked against the file size before anything is allocated, their product can overflow
+	file.seekg(0, std::ios::end);
+	const size_t data_size = static_cast<size_t>(file.tellg()) - header_size;
+
+	size_t element_count = tensor.shape.empty() ? 0: 1;
+	for(auto dim: tensor.shape)
+	{
+		if( dim != 0 && element_count > data_size / element_size / dim )
+		{
+			throw std::runtime_error("Truncated IDX data in " + file_path);
+		}
+
+		element_count *= dim;
+	}
+
+	tensor.data.resize(element_count * element_size);
+
+	if( tensor.data.size() < parallel_threshold )
+		thread_count = 1;
+
+	// Each chunk is read through its own stream, straight to its place in the buffer
+	std::atomic<bool> failed {false};
+	parallel_for(element_count, [&](size_t begin, size_t end) {
+		std::ifstream chunk_file {file_path, std::ios::in | std::ios::binary};
+		uint8_t *chunk = tensor.data.data() + begin * element_size;
+
+		chunk_file.seekg(header_size + begin * element_size);
+		chunk_file.read( (char*)chunk, (end - begin) * element_size );
+
+		if( chunk_file.fail() )
+		{
+			failed = true;
+			return;
+		}
+
+		if( swap )
+			byte_swap(chunk, end - begin, element_size);
+	}, thread_count);
+
+	if( failed )
+	{
+		throw std::runtime_error("Truncated IDX data in " + file_path);
+	}
+
+	return tensor;
+}
+
+} // namespace IDX
\ No newline at end of file
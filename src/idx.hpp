@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace IDX
+{
+
+/**
+ * @brief Element types an IDX file can hold, the value is the type code stored in the third byte of the magic number
+ *
+ */
+enum class DType : uint8_t
+{
+	U8 = 0x08, I8 = 0x09, I16 = 0x0B, I32 = 0x0C, F32 = 0x0D, F64 = 0x0E
+};
+
+/**
+ * @brief Size in bytes of one element of the given type
+ *
+ * @param dtype
+ * @return size_t
+ */
+size_t dtype_size(DType dtype);
+
+/**
+ * @brief Content of an IDX file: a row-major tensor of any rank, stored in the host's byte order
+ *
+ */
+struct Tensor
+{
+	/**
+	 * @brief Total number of elements, that is the product of the dimensions
+	 *
+	 * @return size_t
+	 */
+	size_t element_count() const;
+
+	/**
+	 * @brief Number of elements in one entry along the first dimension (ex: the pixels of one image)
+	 *
+	 * @return size_t
+	 */
+	size_t sample_size() const;
+
+	// Reinterprets the buffer, T must match dtype
+	template<typename T>
+	const T *as() const { return reinterpret_cast<const T*>(data.data()); }
+
+	/**
+	 * @brief Converts elements [first, first+count) to double, multiplied by scale
+	 *
+	 * @param out Must hold at least count elements
+	 * @param first
+	 * @param count
+	 * @param scale
+	 */
+	void to_double(double *out, size_t first, size_t count, double scale = 1.0) const;
+
+	DType dtype {DType::U8};
+	std::vector<uint32_t> shape;
+	std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Loads an IDX file of any type and rank. Big files are read and byte-swapped
+ * in parallel, each thread decoding its own chunk directly into the tensor buffer
+ *
+ * @param file_path
+ * @param thread_count 0 means std::thread::hardware_concurrency()
+ * @return Tensor
+ */
+Tensor load(const std::string &file_path, unsigned thread_count = 0);
+
+} // namespace IDX
\ No newline at end of file
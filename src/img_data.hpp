@@ -21,7 +21,7 @@ struct Image
 };
 
 /**
- * @brief Loads the MNIST images data in file_path
+ * @brief Loads the MNIST images data in file_path (an unsigned byte, rank 3 IDX file)
  * 
  * @param file_path 
  * @return std::vector<Image> 
@@ -29,7 +29,7 @@ struct Image
 std::vector<Image> load_images( const std::string &file_path );
 
 /**
- * @brief Loads the MNIST image labels located in file_path
+ * @brief Loads the MNIST image labels located in file_path (an unsigned byte, rank 1 IDX file)
  * 
  * @param file_path 
  * @return std::vector<uint8_t> 
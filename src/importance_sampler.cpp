@@ -0,0 +1,84 @@
+#include "importance_sampler.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+namespace NN
+{
+
+ImportanceSampler::ImportanceSampler(size_t sample_count, const ImportanceSettings &settings, uint32_t seed):
+	m_settings(settings),
+	m_sample_count(sample_count),
+	m_leaf_count(1),
+	m_rng(seed)
+{
+	assert(sample_count > 0);
+	while(m_leaf_count < sample_count)
+		m_leaf_count *= 2;
+
+	// The leaves past sample_count keep a priority of 0 and are never drawn
+	m_tree.assign(2 * m_leaf_count, 0.0);
+
+	const double priority = std::pow(settings.initial_loss + settings.epsilon, settings.alpha);
+	std::fill(m_tree.begin() + m_leaf_count, m_tree.begin() + m_leaf_count + sample_count, priority);
+
+	for(size_t node = m_leaf_count - 1; node > 0; --node)
+		m_tree[node] = m_tree[2 * node] + m_tree[2 * node + 1];
+}
+
+void ImportanceSampler::sample(size_t batch_size, std::vector<uint32_t> &indices, std::vector<double> &weights)
+{
+	indices.resize(batch_size);
+	weights.resize(batch_size);
+
+	const double total = m_tree[1];
+	const double slice = total / batch_size;
+	std::uniform_real_distribution<double> distribution(0.0, slice);
+
+	double weight_sum = 0.0;
+	for(size_t i = 0; i < batch_size; ++i)
+	{
+		// Goes down to the leaf whose range of the cumulated priorities holds the target
+		double target = std::min(i * slice + distribution(m_rng), std::nextafter(total, 0.0));
+		size_t node = 1;
+		while(node < m_leaf_count)
+		{
+			if(target < m_tree[2 * node] || m_tree[2 * node + 1] == 0.0)
+			{
+				node = 2 * node;
+			}
+			else
+			{
+				target -= m_tree[2 * node];
+				node = 2 * node + 1;
+			}
+		}
+
+		indices[i] = node - m_leaf_count;
+		weights[i] = std::pow(m_sample_count * m_tree[node] / total, -m_settings.beta);
+		weight_sum += weights[i];
+	}
+
+	// The weights average to 1, so that the learning rate keeps its meaning
+	for(auto &weight: weights)
+		weight *= batch_size / weight_sum;
+}
+
+void ImportanceSampler::update(uint32_t index, double loss)
+{
+	assert(index < m_sample_count);
+
+	size_t node = m_leaf_count + index;
+	m_tree[node] = std::pow(loss + m_settings.epsilon, m_settings.alpha);
+
+	for(node /= 2; node > 0; node /= 2)
+		m_tree[node] = m_tree[2 * node] + m_tree[2 * node + 1];
+}
+
+double ImportanceSampler::probability(uint32_t index) const
+{
+	return m_tree[m_leaf_count + index] / m_tree[1];
+}
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+struct ImportanceSettings
+{
+	// Priority of a sample: (loss + epsilon)^alpha. 0 gives uniform sampling, 1 sampling proportional to the loss
+	double alpha = 0.6;
+
+	// Keeps the samples already learned from never being drawn again
+	double epsilon = 0.01;
+
+	// Exponent of the importance weights (1 / (N * P(i)))^beta, 1 fully corrects the bias of the sampling.
+	// A partial correction keeps more of the speedup
+	double beta = 0.5;
+
+	// Loss estimate of the samples not seen yet, every sample is as likely until its loss is measured
+	double initial_loss = 2.3;
+};
+
+/**
+ * @brief Draws training samples proportionally to an estimate of their loss, kept in a sum-tree: updating
+ * an estimate and drawing a sample take O(log N). The estimates are the losses computed by the forward passes
+ * of the training (see Optimizer::accumulate), so they cost nothing more
+ * 
+ */
+class ImportanceSampler
+{
+public:
+	ImportanceSampler(size_t sample_count, const ImportanceSettings &settings = ImportanceSettings(), uint32_t seed = 0);
+
+	/**
+	 * @brief Draws a batch, one sample in each of batch_size equal slices of the total priority (stratified sampling)
+	 * 
+	 * @param batch_size 
+	 * @param indices Replaced by the indices of the samples
+	 * @param weights Replaced by their importance weights, scaled to average 1 over the batch, to scale their gradient
+	 */
+	void sample(size_t batch_size, std::vector<uint32_t> &indices, std::vector<double> &weights);
+
+	/**
+	 * @brief Replaces the loss estimate of a sample
+	 * 
+	 * @param index 
+	 * @param loss 
+	 */
+	void update(uint32_t index, double loss);
+
+	inline size_t size() const { return m_sample_count; }
+
+	// Probability of drawing a sample
+	double probability(uint32_t index) const;
+
+private:
+	ImportanceSettings m_settings;
+	size_t m_sample_count;
+
+	// Number of leaves, a power of two. Node i has children 2i and 2i+1, the leaves start at m_leaf_count
+	size_t m_leaf_count;
+	std::vector<double> m_tree;
+	std::mt19937 m_rng;
+};
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include "inference_server.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+namespace NN
+{
+
+// Number of latencies kept for the percentiles
+constexpr size_t latency_window = 10000;
+
+// How often run() checks whether the server was stopped
+constexpr int accept_poll_ms = 100;
+
+// How often run() checks whether the answers left were sent, once the server stopped
+constexpr int flush_poll_ms = 10;
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+static bool read_all(int fd, void *data, size_t size)
+{
+	auto bytes = static_cast<char*>(data);
+	while(size > 0)
+	{
+		ssize_t received = recv(fd, bytes, size, 0);
+		if(received <= 0)
+			return false;
+
+		bytes += received;
+		size -= received;
+	}
+
+	return true;
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+	auto bytes = static_cast<const char*>(data);
+	while(size > 0)
+	{
+		ssize_t sent = send(fd, bytes, size, send_flags);
+		if(sent <= 0)
+			return false;
+
+		bytes += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+InferenceServer::Connection::~Connection()
+{
+	if(fd >= 0)
+		close(fd);
+}
+
+InferenceServer::InferenceServer(const NeuralNet &network, const ServerSettings &settings):
+	m_network(network),
+	m_settings(settings),
+	m_start(std::chrono::steady_clock::now())
+{
+	if(settings.max_batch_size == 0 || settings.max_pending_answers == 0)
+		throw std::runtime_error("The largest batch size and the number of pending answers must be positive");
+
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+	if(settings.socket_path.size() >= sizeof(address.sun_path))
+		throw std::runtime_error("Socket path too long: " + settings.socket_path);
+
+	std::strncpy(address.sun_path, settings.socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+	// A previous server may have left its socket file behind
+	unlink(settings.socket_path.c_str());
+
+	m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(m_listen_fd < 0 || bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(m_listen_fd, 64) != 0)
+	{
+		if(m_listen_fd >= 0)
+			close(m_listen_fd);
+		throw std::runtime_error("Cannot listen on " + settings.socket_path);
+	}
+
+	m_latencies.reserve(latency_window);
+	m_batch_thread = std::thread(&InferenceServer::batch_loop, this);
+}
+
+InferenceServer::~InferenceServer()
+{
+	stop();
+
+	if(m_batch_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_queue_mutex);
+			m_readers_done = true;
+		}
+
+		m_queue_cv.notify_all();
+		m_batch_thread.join();
+	}
+
+	close(m_listen_fd);
+	unlink(m_settings.socket_path.c_str());
+}
+
+void InferenceServer::run()
+{
+	while(!m_stop)
+	{
+		// Forgets the connections that were closed
+		for(auto it = m_clients.begin(); it != m_clients.end();)
+		{
+			if(it->connection->finished < 2)
+			{
+				++it;
+				continue;
+			}
+
+			it->reader.join();
+			it->writer.join();
+			it = m_clients.erase(it);
+		}
+
+		pollfd listen_poll {m_listen_fd, POLLIN, 0};
+		if(poll(&listen_poll, 1, accept_poll_ms) <= 0)
+			continue;
+
+		int fd = accept(m_listen_fd, nullptr, nullptr);
+		if(fd < 0)
+			continue;
+
+		Client client;
+		client.connection = std::make_shared<Connection>();
+		client.connection->fd = fd;
+		client.reader = std::thread(&InferenceServer::read_requests, this, client.connection);
+		client.writer = std::thread(&InferenceServer::write_answers, this, client.connection);
+
+		m_clients.push_back(std::move(client));
+	}
+
+	// Unblocks the readers, the answers can still be sent
+	for(auto &client: m_clients)
+	{
+		shutdown(client.connection->fd, SHUT_RD);
+		client.reader.join();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		m_readers_done = true;
+	}
+
+	m_queue_cv.notify_all();
+	m_batch_thread.join();
+
+	// Every answer is queued, the clients which still didn't read theirs after the flush timeout are disconnected
+	auto deadline = std::chrono::steady_clock::now() + m_settings.flush_timeout;
+	for(auto &client: m_clients)
+	{
+		while(client.connection->finished < 2 && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(flush_poll_ms));
+
+		if(client.connection->finished < 2)
+			shutdown(client.connection->fd, SHUT_RDWR);
+
+		client.writer.join();
+	}
+
+	m_clients.clear();
+}
+
+void InferenceServer::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		m_stop = true;
+	}
+
+	m_queue_cv.notify_all();
+}
+
+ServerStats InferenceServer::stats() const
+{
+	std::vector<uint32_t> latencies;
+	ServerStats stats;
+
+	{
+		std::lock_guard<std::mutex> lock(m_stats_mutex);
+		latencies = m_latencies;
+		stats.requests = m_requests;
+		stats.batches = m_batches;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+	stats.throughput = stats.requests / seconds;
+
+	if(latencies.empty())
+		return stats;
+
+	auto percentile = [&](double p) {
+		auto nth = latencies.begin() + static_cast<size_t>(p * (latencies.size() - 1));
+		std::nth_element(latencies.begin(), nth, latencies.end());
+		return *nth / 1000.0;
+	};
+
+	stats.p50_latency_ms = percentile(0.5);
+	stats.p99_latency_ms = percentile(0.99);
+
+	return stats;
+}
+
+void InferenceServer::read_requests(std::shared_ptr<Connection> connection)
+{
+	const size_t request_size = m_network.input_size();
+
+	for(;;)
+	{
+		Request request;
+		request.pixels.resize(request_size);
+
+		if(!read_all(connection->fd, request.pixels.data(), request_size))
+			break;
+
+		request.arrival = std::chrono::steady_clock::now();
+		request.connection = connection;
+
+		{
+			std::lock_guard<std::mutex> lock(connection->mutex);
+			++connection->pending;
+		}
+
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		m_queue.push_back(std::move(request));
+		m_queue_cv.notify_all();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(connection->mutex);
+		connection->reading = false;
+	}
+
+	connection->cv.notify_all();
+	++connection->finished;
+}
+
+void InferenceServer::write_answers(std::shared_ptr<Connection> connection)
+{
+	std::vector<char> sending;
+	std::vector<std::chrono::steady_clock::time_point> arrivals;
+
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(connection->mutex);
+			connection->cv.wait(lock, [&]() {
+				return !connection->outbound.empty() || connection->dropped || (!connection->reading && connection->pending == 0);
+			});
+
+			// Either shut down, or every request was read and answered
+			if(connection->dropped || connection->outbound.empty())
+				break;
+
+			sending.swap(connection->outbound);
+			arrivals.swap(connection->arrivals);
+		}
+
+		if(!write_all(connection->fd, sending.data(), sending.size()))
+		{
+			// The client disconnected, its reader stops too
+			std::lock_guard<std::mutex> lock(connection->mutex);
+			connection->dropped = true;
+			shutdown(connection->fd, SHUT_RDWR);
+			break;
+		}
+
+		record_latencies(arrivals);
+		sending.clear();
+		arrivals.clear();
+	}
+
+	++connection->finished;
+}
+
+void InferenceServer::queue_answer(Connection &connection, const std::vector<char> &answer, std::chrono::steady_clock::time_point arrival)
+{
+	{
+		std::lock_guard<std::mutex> lock(connection.mutex);
+		--connection.pending;
+
+		if(connection.dropped)
+			return;
+
+		if(connection.outbound.size() >= m_settings.max_pending_answers * answer.size())
+		{
+			// The client doesn't read its answers, buffering them would have no bound
+			connection.dropped = true;
+			connection.outbound.clear();
+			connection.arrivals.clear();
+			shutdown(connection.fd, SHUT_RDWR);
+		}
+		else
+		{
+			connection.outbound.insert(connection.outbound.end(), answer.begin(), answer.end());
+			connection.arrivals.push_back(arrival);
+		}
+	}
+
+	connection.cv.notify_all();
+}
+
+void InferenceServer::batch_loop()
+{
+	const size_t input_size = m_network.input_size();
+	const size_t output_size = m_network.output_size();
+
+	std::vector<Request> batch;
+	std::vector<double> inputs;
+	std::vector<char> answer(1 + output_size * sizeof(float));
+
+	for(;;)
+	{
+		batch.clear();
+
+		{
+			std::unique_lock<std::mutex> lock(m_queue_mutex);
+			m_queue_cv.wait(lock, [this]() { return !m_queue.empty() || m_readers_done; });
+
+			// No request can come anymore, and every request was answered
+			if(m_queue.empty())
+				return;
+
+			// The batch leaves when it is full or when its oldest request used its latency budget
+			auto deadline = m_queue.front().arrival + m_settings.latency_budget;
+			m_queue_cv.wait_until(lock, deadline, [this]() { return m_queue.size() >= m_settings.max_batch_size || m_stop; });
+
+			size_t batch_size = std::min(m_queue.size(), m_settings.max_batch_size);
+			std::move(m_queue.begin(), m_queue.begin() + batch_size, std::back_inserter(batch));
+			m_queue.erase(m_queue.begin(), m_queue.begin() + batch_size);
+		}
+
+		// Scaled to [0, 1] like the training set
+		inputs.resize(batch.size() * input_size);
+		for(size_t i = 0; i < batch.size(); ++i)
+		{
+			for(size_t j = 0; j < input_size; ++j)
+				inputs[i * input_size + j] = batch[i].pixels[j] / 255.0;
+		}
+
+		auto outputs = m_network.forward(inputs.data(), batch.size());
+
+		for(size_t i = 0; i < batch.size(); ++i)
+		{
+			const double *output = outputs.data() + i * output_size;
+			answer[0] = static_cast<char>(std::max_element(output, output + output_size) - output);
+
+			for(size_t j = 0; j < output_size; ++j)
+			{
+				float value = static_cast<float>(output[j]);
+				std::memcpy(answer.data() + 1 + j * sizeof(float), &value, sizeof(float));
+			}
+
+			// Only queued, the connection's writer sends it
+			queue_answer(*batch[i].connection, answer, batch[i].arrival);
+		}
+
+		std::lock_guard<std::mutex> lock(m_stats_mutex);
+		++m_batches;
+	}
+}
+
+void InferenceServer::record_latencies(const std::vector<std::chrono::steady_clock::time_point> &arrivals)
+{
+	auto now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(m_stats_mutex);
+	for(const auto &arrival: arrivals)
+	{
+		auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - arrival).count();
+
+		if(m_latencies.size() < latency_window)
+			m_latencies.push_back(latency);
+		else
+			m_latencies[m_requests % latency_window] = latency;
+
+		++m_requests;
+	}
+}
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "neural_network.hpp"
+#include "dense_net.hpp"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+struct ServerSettings
+{
+	std::string socket_path = "/tmp/autograd_nn.sock";
+
+	// Largest number of requests evaluated together
+	size_t max_batch_size = 64;
+
+	// How long a request can wait for others to join its batch
+	std::chrono::microseconds latency_budget {2000};
+
+	// Answers waiting to be sent on one connection, a client sending requests without reading the answers is
+	// disconnected when it has more
+	size_t max_pending_answers = 1024;
+
+	// How long the answers left when the server stops can wait for clients which don't read them
+	std::chrono::milliseconds flush_timeout {1000};
+};
+
+struct ServerStats
+{
+	// Requests whose answer was written to their connection
+	size_t requests = 0;
+	size_t batches = 0;
+
+	// Time between the reception of a request and the writing of its answer to the socket, over the last requests
+	double p50_latency_ms = 0.0;
+	double p99_latency_ms = 0.0;
+
+	// Requests answered per second since the server started
+	double throughput = 0.0;
+};
+
+/**
+ * @brief Serves classification requests over a Unix domain socket (POSIX only). A request is one raw input of
+ * uint8_t pixels (input_size() bytes, ex: 28x28 for MNIST), its answer is the index of the predicted
+ * class as one byte followed by the output of the network as output_size() floats. A client can send
+ * several requests without waiting, the answers come back in the same order.
+ * Requests from every connection are grouped into batches evaluated by a DenseNet
+ *
+ */
+class InferenceServer
+{
+public:
+	/**
+	 * @brief Copies the parameters of network and starts listening, throws if settings.max_batch_size is 0
+	 *
+	 * @param network
+	 * @param settings
+	 */
+	InferenceServer(const NeuralNet &network, const ServerSettings &settings = ServerSettings());
+
+	// run() must have returned
+	~InferenceServer();
+
+	InferenceServer(const InferenceServer&) = delete;
+	InferenceServer &operator=(const InferenceServer&) = delete;
+
+	// Accepts connections until stop() is called, then answers the requests already received and closes the connections
+	void run();
+
+	// Makes run() return, can be called from any thread
+	void stop();
+
+	ServerStats stats() const;
+
+private:
+	struct Connection
+	{
+		~Connection();
+
+		int fd {-1};
+
+		// Answers not sent yet, written by the batch thread and sent by the connection's writer thread
+		std::vector<char> outbound;
+
+		// Arrival time of the request of each answer in outbound
+		std::vector<std::chrono::steady_clock::time_point> arrivals;
+
+		// Requests read but not answered yet
+		size_t pending = 0;
+
+		bool reading = true;
+
+		// Set when the connection is shut down, its answers are discarded
+		bool dropped = false;
+
+		std::mutex mutex;
+		std::condition_variable cv;
+
+		// How many of its reader and writer threads returned
+		std::atomic<int> finished {0};
+	};
+
+	// Each connection is read and written by its own threads, so that a slow client only blocks itself
+	struct Client
+	{
+		std::thread reader;
+		std::thread writer;
+		std::shared_ptr<Connection> connection;
+	};
+
+	struct Request
+	{
+		std::shared_ptr<Connection> connection;
+		std::vector<uint8_t> pixels;
+		std::chrono::steady_clock::time_point arrival;
+	};
+
+	void read_requests(std::shared_ptr<Connection> connection);
+
+	void write_answers(std::shared_ptr<Connection> connection);
+
+	// Appends an answer to the outbound buffer of connection, or shuts it down if too many answers are waiting
+	void queue_answer(Connection &connection, const std::vector<char> &answer, std::chrono::steady_clock::time_point arrival);
+
+	// Adds the latencies of requests whose answers were just sent
+	void record_latencies(const std::vector<std::chrono::steady_clock::time_point> &arrivals);
+
+	void batch_loop();
+
+	DenseNet m_network;
+	ServerSettings m_settings;
+	int m_listen_fd {-1};
+	std::atomic<bool> m_stop {false};
+
+	std::deque<Request> m_queue;
+	std::mutex m_queue_mutex;
+	std::condition_variable m_queue_cv;
+	std::thread m_batch_thread;
+
+	// Only used by run()
+	std::vector<Client> m_clients;
+
+	// Set once the readers returned, the batch thread then stops when the queue is empty
+	bool m_readers_done = false;
+
+	// Latencies of the last requests in microseconds, used as a circular buffer
+	std::vector<uint32_t> m_latencies;
+	size_t m_requests = 0;
+	size_t m_batches = 0;
+	std::chrono::steady_clock::time_point m_start;
+	mutable std::mutex m_stats_mutex;
+};
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,370 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace NN
+{
+
+void gemm(
+	size_t m, size_t n, size_t k,
+	const double *a, bool transpose_a,
+	const double *b, bool transpose_b,
+	double *c, bool accumulate
+)
+{
+	if(!accumulate)
+		std::fill(c, c + m*n, 0.0);
+
+	if(!transpose_b)
+	{
+		// C row i += a(i, p) * B row p: the inner loop is contiguous in B and C
+		for(size_t i = 0; i < m; ++i)
+		{
+			double *c_row = c + i*n;
+			for(size_t p = 0; p < k; ++p)
+			{
+				const double a_ip = transpose_a ? a[p*m + i]: a[i*k + p];
+				const double *b_row = b + p*n;
+				for(size_t j = 0; j < n; ++j)
+					c_row[j] += a_ip * b_row[j];
+			}
+		}
+	}
+	else if(!transpose_a)
+	{
+		// Every element of C is a dot product between a row of A and a row of B
+		for(size_t i = 0; i < m; ++i)
+		{
+			const double *a_row = a + i*k;
+			for(size_t j = 0; j < n; ++j)
+			{
+				const double *b_row = b + j*k;
+				double sum = 0.0;
+				for(size_t p = 0; p < k; ++p)
+					sum += a_row[p] * b_row[p];
+				c[i*n + j] += sum;
+			}
+		}
+	}
+	else
+	{
+		for(size_t i = 0; i < m; ++i)
+		{
+			for(size_t j = 0; j < n; ++j)
+			{
+				double sum = 0.0;
+				for(size_t p = 0; p < k; ++p)
+					sum += a[p*m + i] * b[j*k + p];
+				c[i*n + j] += sum;
+			}
+		}
+	}
+}
+
+// Samples sharing the loads of csr_linear_forward, their sums stay in registers
+constexpr size_t csr_sample_group = 8;
+
+CsrMatrix CsrMatrix::from_dense(const double *dense, size_t rows, size_t cols)
+{
+	CsrMatrix matrix;
+	matrix.rows = rows;
+	matrix.cols = cols;
+	matrix.row_offsets.reserve(rows + 1);
+	matrix.row_offsets.push_back(0);
+
+	for(size_t i = 0; i < rows; ++i)
+	{
+		for(size_t j = 0; j < cols; ++j)
+		{
+			if(dense[i*cols + j] == 0.0)
+				continue;
+
+			matrix.columns.push_back(j);
+			matrix.values.push_back(dense[i*cols + j]);
+		}
+
+		matrix.row_offsets.push_back(matrix.values.size());
+	}
+
+	return matrix;
+}
+
+size_t CsrMatrix::bytes() const
+{
+	return row_offsets.size() * sizeof(uint32_t) + columns.size() * sizeof(uint32_t) + values.size() * sizeof(double);
+}
+
+void csr_linear_forward(size_t batch_size, const CsrMatrix &weights, const double *biases, const double *input, double *output)
+{
+	const size_t in_size = weights.cols;
+	const size_t out_size = weights.rows;
+
+	for(size_t first = 0; first < batch_size; first += csr_sample_group)
+	{
+		const size_t group = std::min(csr_sample_group, batch_size - first);
+		const double *x = input + first * in_size;
+
+		for(size_t o = 0; o < out_size; ++o)
+		{
+			double sums[csr_sample_group];
+			std::fill(sums, sums + group, biases[o]);
+
+			for(uint32_t e = weights.row_offsets[o]; e < weights.row_offsets[o+1]; ++e)
+			{
+				const double w = weights.values[e];
+				const double *column = x + weights.columns[e];
+				for(size_t s = 0; s < group; ++s)
+					sums[s] += w * column[s * in_size];
+			}
+
+			for(size_t s = 0; s < group; ++s)
+				output[(first + s) * out_size + o] = sums[s];
+		}
+	}
+}
+
+void linear_backward_sparse(
+	size_t batch_size, size_t input_size, size_t output_size,
+	const double *input,
+	const double *weights,
+	const double *output_diff,
+	double *weights_diff,
+	double *biases_diff,
+	double *input_diff
+)
+{
+	std::vector<uint32_t> live_inputs;
+	live_inputs.reserve(input_size);
+
+	for(size_t s = 0; s < batch_size; ++s)
+	{
+		const double *x = input + s * input_size;
+		const double *dy = output_diff + s * output_size;
+		double *dx = input_diff ? input_diff + s * input_size: nullptr;
+
+		live_inputs.clear();
+		for(size_t i = 0; i < input_size; ++i)
+		{
+			if(x[i] != 0.0)
+				live_inputs.push_back(i);
+		}
+
+		if(dx)
+			std::fill(dx, dx + input_size, 0.0);
+
+		for(size_t o = 0; o < output_size; ++o)
+		{
+			const double diff = dy[o];
+			if(diff == 0.0)
+				continue;
+
+			// Only the live row of dW, restricted to the non zero inputs
+			double *dw_row = weights_diff + o * input_size;
+			for(auto i: live_inputs)
+				dw_row[i] += diff * x[i];
+
+			biases_diff[o] += diff;
+
+			if(dx)
+			{
+				const double *w_row = weights + o * input_size;
+				for(size_t i = 0; i < input_size; ++i)
+					dx[i] += diff * w_row[i];
+			}
+		}
+	}
+}
+
+void im2col(const Layer &layer, const double *input, double *columns)
+{
+	const int out_height = layer.output_height();
+	const int out_width = layer.output_width();
+
+	for(int c = 0; c < layer.channels; ++c)
+	for(int ky = 0; ky < layer.kernel; ++ky)
+	for(int kx = 0; kx < layer.kernel; ++kx)
+	{
+		for(int oy = 0; oy < out_height; ++oy)
+		{
+			const int iy = oy * layer.stride - layer.padding + ky;
+			for(int ox = 0; ox < out_width; ++ox)
+			{
+				const int ix = ox * layer.stride - layer.padding + kx;
+				const bool inside = iy >= 0 && iy < layer.height && ix >= 0 && ix < layer.width;
+				*columns++ = inside ? input[(c * layer.height + iy) * layer.width + ix]: 0.0;
+			}
+		}
+	}
+}
+
+void col2im(const Layer &layer, const double *columns, double *input)
+{
+	const int out_height = layer.output_height();
+	const int out_width = layer.output_width();
+
+	for(int c = 0; c < layer.channels; ++c)
+	for(int ky = 0; ky < layer.kernel; ++ky)
+	for(int kx = 0; kx < layer.kernel; ++kx)
+	{
+		for(int oy = 0; oy < out_height; ++oy)
+		{
+			const int iy = oy * layer.stride - layer.padding + ky;
+			for(int ox = 0; ox < out_width; ++ox, ++columns)
+			{
+				const int ix = ox * layer.stride - layer.padding + kx;
+				if(iy >= 0 && iy < layer.height && ix >= 0 && ix < layer.width)
+					input[(c * layer.height + iy) * layer.width + ix] += *columns;
+			}
+		}
+	}
+}
+
+// Each filter tap is applied as a shifted multiply-add over a whole output row, which keeps
+// the inner loop contiguous and avoids materializing the 9x larger im2col buffer
+static void conv3x3_direct(const Layer &layer, const double *weights, const double *biases, const double *input, double *output)
+{
+	const int out_height = layer.output_height();
+	const int out_width = layer.output_width();
+
+	for(int oc = 0; oc < layer.out_channels; ++oc)
+	{
+		double *out = output + oc * out_height * out_width;
+		std::fill(out, out + out_height * out_width, biases[oc]);
+
+		for(int c = 0; c < layer.channels; ++c)
+		{
+			const double *in = input + c * layer.height * layer.width;
+			const double *w = weights + (oc * layer.channels + c) * 9;
+
+			for(int ky = 0; ky < 3; ++ky)
+			for(int kx = 0; kx < 3; ++kx)
+			{
+				const double weight = w[ky * 3 + kx];
+				const int dx = kx - layer.padding;
+				const int first_x = std::max(0, -dx);
+				const int last_x = std::min(out_width, layer.width - dx);
+
+				for(int oy = 0; oy < out_height; ++oy)
+				{
+					const int iy = oy + ky - layer.padding;
+					if(iy < 0 || iy >= layer.height)
+						continue;
+
+					const double *in_row = in + iy * layer.width;
+					double *out_row = out + oy * out_width;
+					for(int ox = first_x; ox < last_x; ++ox)
+						out_row[ox] += weight * in_row[ox + dx];
+				}
+			}
+		}
+	}
+}
+
+void conv2d_forward(const Layer &layer, const double *weights, const double *biases, const double *input, double *output)
+{
+	assert(layer.operation == Layer::Func::CONV2D);
+
+	if(layer.kernel == 3 && layer.stride == 1)
+	{
+		conv3x3_direct(layer, weights, biases, input, output);
+		return;
+	}
+
+	const size_t patch_size = layer.channels * layer.kernel * layer.kernel;
+	const size_t positions = layer.output_height() * layer.output_width();
+
+	std::vector<double> columns(patch_size * positions);
+	im2col(layer, input, columns.data());
+
+	for(int oc = 0; oc < layer.out_channels; ++oc)
+		std::fill(output + oc * positions, output + (oc+1) * positions, biases[oc]);
+
+	gemm(layer.out_channels, positions, patch_size, weights, false, columns.data(), false, output, true);
+}
+
+void conv2d_backward(
+	const Layer &layer,
+	const double *weights,
+	const double *input,
+	const double *output_diff,
+	double *weights_diff,
+	double *biases_diff,
+	double *input_diff
+)
+{
+	assert(layer.operation == Layer::Func::CONV2D);
+
+	const size_t patch_size = layer.channels * layer.kernel * layer.kernel;
+	const size_t positions = layer.output_height() * layer.output_width();
+
+	std::vector<double> columns(patch_size * positions);
+	im2col(layer, input, columns.data());
+
+	for(int oc = 0; oc < layer.out_channels; ++oc)
+	{
+		for(size_t p = 0; p < positions; ++p)
+			biases_diff[oc] += output_diff[oc * positions + p];
+	}
+
+	// dW += dY * columns^T
+	gemm(layer.out_channels, patch_size, positions, output_diff, false, columns.data(), true, weights_diff, true);
+
+	if(!input_diff)
+		return;
+
+	// dcolumns = W^T * dY, then fold the patches back
+	gemm(patch_size, positions, layer.out_channels, weights, true, output_diff, false, columns.data(), false);
+	std::fill(input_diff, input_diff + layer.input_size, 0.0);
+	col2im(layer, columns.data(), input_diff);
+}
+
+void softmax_forward(const double *input, size_t size, double *output)
+{
+	const double max_input = *std::max_element(input, input + size);
+
+	double exp_total = 0.0;
+	for(size_t i = 0; i < size; ++i)
+	{
+		output[i] = exp(input[i] - max_input);
+		exp_total += output[i];
+	}
+
+	for(size_t i = 0; i < size; ++i)
+		output[i] /= exp_total;
+}
+
+void maxpool2d_forward(const Layer &layer, const double *input, double *output, uint32_t *argmax)
+{
+	const int out_height = layer.output_height();
+	const int out_width = layer.output_width();
+
+	for(int c = 0; c < layer.channels; ++c)
+	for(int oy = 0; oy < out_height; ++oy)
+	for(int ox = 0; ox < out_width; ++ox)
+	{
+		uint32_t best = (c * layer.height + oy * layer.stride) * layer.width + ox * layer.stride;
+
+		for(int ky = 0; ky < layer.kernel; ++ky)
+		for(int kx = 0; kx < layer.kernel; ++kx)
+		{
+			uint32_t index = (c * layer.height + oy * layer.stride + ky) * layer.width + ox * layer.stride + kx;
+			if(input[index] > input[best])
+				best = index;
+		}
+
+		*output++ = input[best];
+		*argmax++ = best;
+	}
+}
+
+void maxpool2d_backward(const Layer &layer, const uint32_t *argmax, const double *output_diff, double *input_diff)
+{
+	std::fill(input_diff, input_diff + layer.input_size, 0.0);
+
+	for(int i = 0; i < layer.output_size; ++i)
+		input_diff[argmax[i]] += output_diff[i];
+}
+
+} // namespace NN
\ No newline at end of file
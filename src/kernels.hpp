@@ -0,0 +1,176 @@
+#pragma once
+
+#include "neural_network.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+/**
+ * @brief Row-major matrix product C = op(A) * op(B), where op(X) is X or its transpose
+ *
+ * @param m Rows of op(A) and C
+ * @param n Columns of op(B) and C
+ * @param k Columns of op(A), rows of op(B)
+ * @param a
+ * @param transpose_a
+ * @param b
+ * @param transpose_b
+ * @param c
+ * @param accumulate If true, the product is added to C instead of overwriting it
+ */
+void gemm(
+	size_t m, size_t n, size_t k,
+	const double *a, bool transpose_a,
+	const double *b, bool transpose_b,
+	double *c, bool accumulate = false
+);
+
+/**
+ * @brief Backward pass of a LINEAR layer (Y = X * W^T + b) that only visits the live entries: the outputs
+ * with a non zero differential (the units a following relu kept active) and the non zero inputs.
+ * Faster than the gemm based pass when most of them are zero
+ *
+ * @param batch_size
+ * @param input_size
+ * @param output_size
+ * @param input batch_size x input_size
+ * @param weights output_size x input_size
+ * @param output_diff batch_size x output_size
+ * @param weights_diff Accumulated into
+ * @param biases_diff Accumulated into
+ * @param input_diff Overwritten, can be null if not needed
+ */
+void linear_backward_sparse(
+	size_t batch_size, size_t input_size, size_t output_size,
+	const double *input,
+	const double *weights,
+	const double *output_diff,
+	double *weights_diff,
+	double *biases_diff,
+	double *input_diff
+);
+
+/**
+ * @brief Compressed sparse row matrix: the non zero entries of row i are values[row_offsets[i]] to
+ * values[row_offsets[i+1]-1], in the columns columns[row_offsets[i]] to columns[row_offsets[i+1]-1]
+ *
+ */
+struct CsrMatrix
+{
+	/**
+	 * @brief Keeps the non zero entries of a row-major matrix
+	 *
+	 * @param dense rows x cols
+	 * @param rows
+	 * @param cols
+	 * @return CsrMatrix
+	 */
+	static CsrMatrix from_dense(const double *dense, size_t rows, size_t cols);
+
+	// Memory used by the entries and their indices, in bytes
+	size_t bytes() const;
+
+	size_t rows {0};
+	size_t cols {0};
+	std::vector<uint32_t> row_offsets;
+	std::vector<uint32_t> columns;
+	std::vector<double> values;
+};
+
+/**
+ * @brief Forward pass of a LINEAR layer (Y = X * W^T + b) with sparse weights. The samples are processed by
+ * groups sharing each load of an entry and its column, the cost is proportional to the number of non zero weights
+ *
+ * @param batch_size
+ * @param weights output_size x input_size
+ * @param biases output_size
+ * @param input batch_size x input_size
+ * @param output batch_size x output_size, overwritten
+ */
+void csr_linear_forward(size_t batch_size, const CsrMatrix &weights, const double *biases, const double *input, double *output);
+
+/**
+ * @brief Unfolds the input of a CONV2D layer so that each column holds the patch seen by one output position
+ *
+ * @param layer
+ * @param input channels x height x width
+ * @param columns (channels*kernel*kernel) x (output_height*output_width)
+ */
+void im2col(const Layer &layer, const double *input, double *columns);
+
+/**
+ * @brief Inverse of im2col: adds every patch back to its place in the input, the overlaps are summed
+ *
+ * @param layer
+ * @param columns (channels*kernel*kernel) x (output_height*output_width)
+ * @param input channels x height x width, accumulated into
+ */
+void col2im(const Layer &layer, const double *columns, double *input);
+
+/**
+ * @brief Forward pass of a CONV2D layer for one sample. Uses a direct kernel for 3x3 filters
+ * with a stride of 1, im2col + gemm otherwise
+ *
+ * @param layer
+ * @param weights out_channels x channels x kernel x kernel
+ * @param biases out_channels
+ * @param input channels x height x width
+ * @param output out_channels x output_height x output_width
+ */
+void conv2d_forward(const Layer &layer, const double *weights, const double *biases, const double *input, double *output);
+
+/**
+ * @brief Backward pass of a CONV2D layer for one sample, through im2col + gemm + col2im
+ *
+ * @param layer
+ * @param weights
+ * @param input The input given to conv2d_forward
+ * @param output_diff Differential of the loss over the output
+ * @param weights_diff Accumulated into
+ * @param biases_diff Accumulated into
+ * @param input_diff Overwritten, can be null if not needed
+ */
+void conv2d_backward(
+	const Layer &layer,
+	const double *weights,
+	const double *input,
+	const double *output_diff,
+	double *weights_diff,
+	double *biases_diff,
+	double *input_diff
+);
+
+/**
+ * @brief Softmax of one vector, shifted by its maximum so that exp can't overflow
+ *
+ * @param input
+ * @param size
+ * @param output
+ */
+void softmax_forward(const double *input, size_t size, double *output);
+
+/**
+ * @brief Forward pass of a MAXPOOL2D layer for one sample
+ *
+ * @param layer
+ * @param input
+ * @param output
+ * @param argmax Index in the input of each selected value, used by the backward pass
+ */
+void maxpool2d_forward(const Layer &layer, const double *input, double *output, uint32_t *argmax);
+
+/**
+ * @brief Backward pass of a MAXPOOL2D layer for one sample
+ *
+ * @param layer
+ * @param argmax Filled by maxpool2d_forward
+ * @param output_diff
+ * @param input_diff Overwritten
+ */
+void maxpool2d_backward(const Layer &layer, const uint32_t *argmax, const double *output_diff, double *input_diff);
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "lbfgs.hpp"
+#include "utils.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+namespace NN
+{
+
+// A pair with s.y below this fraction of |s||y| would make the approximation indefinite, it is dropped
+constexpr double curvature_epsilon = 1e-10;
+
+// Four independent sums, so that the additions can be vectorized without reordering a single sum
+static double dot(const double *a, const double *b, size_t size)
+{
+	double sums[4] = {0.0, 0.0, 0.0, 0.0};
+
+	size_t i = 0;
+	for(; i + 4 <= size; i += 4)
+	{
+		for(size_t j = 0; j < 4; ++j)
+			sums[j] += a[i+j] * b[i+j];
+	}
+
+	for(; i < size; ++i)
+		sums[0] += a[i] * b[i];
+
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+// y += a * x
+static void axpy(double a, const double *x, double *y, size_t size)
+{
+	for(size_t i = 0; i < size; ++i)
+		y[i] += a * x[i];
+}
+
+LBFGS::LBFGS(DenseNet &network, const double *inputs, const uint32_t *labels, size_t sample_count, const LBFGSSettings &settings):
+	m_network(network),
+	m_inputs(inputs),
+	m_labels(labels),
+	m_sample_count(sample_count),
+	m_settings(settings)
+{
+	assert(sample_count > 0 && settings.history > 0 && settings.chunk_size > 0);
+
+	const size_t n = network.parameter_count();
+	const size_t chunk_count = (sample_count + settings.chunk_size - 1) / settings.chunk_size;
+
+	m_gradient.resize(n);
+	m_s.resize(settings.history * n);
+	m_y.resize(settings.history * n);
+	m_rho.resize(settings.history);
+	m_alpha.resize(settings.history);
+	m_direction.resize(n);
+	m_start.resize(n);
+	m_trial_gradient.resize(n);
+	m_partial_gradients.resize(chunk_count * n);
+	m_partial_losses.resize(chunk_count);
+
+	m_loss = evaluate(m_gradient);
+}
+
+double LBFGS::evaluate(std::vector<double> &gradient)
+{
+	const size_t n = m_network.parameter_count();
+	const size_t input_size = m_network.input_size();
+	const size_t chunk_size = m_settings.chunk_size;
+
+	parallel_for(m_partial_losses.size(), [&](size_t begin, size_t end) {
+		for(size_t chunk = begin; chunk < end; ++chunk)
+		{
+			size_t first = chunk * chunk_size;
+			size_t size = std::min(chunk_size, m_sample_count - first);
+			double *partial = m_partial_gradients.data() + chunk * n;
+
+			std::fill(partial, partial + n, 0.0);
+			m_partial_losses[chunk] = m_network.gradient(m_inputs + first * input_size, m_labels + first, size, partial);
+		}
+	}, m_settings.thread_count);
+
+	std::fill(gradient.begin(), gradient.end(), 0.0);
+	double loss = 0.0;
+	for(size_t chunk = 0; chunk < m_partial_losses.size(); ++chunk)
+	{
+		axpy(1.0, m_partial_gradients.data() + chunk * n, gradient.data(), n);
+		loss += m_partial_losses[chunk];
+	}
+
+	for(auto &g: gradient)
+		g /= (double)m_sample_count;
+
+	++m_evaluations;
+	return loss / (double)m_sample_count;
+}
+
+void LBFGS::compute_direction()
+{
+	const size_t n = m_gradient.size();
+	const size_t history = m_settings.history;
+	auto row = [&](size_t i) { return (m_newest + 1 + i + history - m_pair_count) % history; };
+
+	std::copy(m_gradient.begin(), m_gradient.end(), m_direction.begin());
+
+	for(size_t i = m_pair_count; i-- > 0;)
+	{
+		size_t r = row(i);
+		m_alpha[r] = m_rho[r] * dot(m_s.data() + r * n, m_direction.data(), n);
+		axpy(-m_alpha[r], m_y.data() + r * n, m_direction.data(), n);
+	}
+
+	// Initial hessian: s.y / y.y of the newest pair, or a first step of length 1
+	double gamma = 0.0;
+	if(m_pair_count > 0)
+	{
+		const double *y = m_y.data() + m_newest * n;
+		gamma = 1.0 / (m_rho[m_newest] * dot(y, y, n));
+	}
+	else
+	{
+		gamma = 1.0 / std::max(std::sqrt(dot(m_gradient.data(), m_gradient.data(), n)), 1e-12);
+	}
+
+	for(auto &d: m_direction)
+		d *= gamma;
+
+	for(size_t i = 0; i < m_pair_count; ++i)
+	{
+		size_t r = row(i);
+		double beta = m_rho[r] * dot(m_y.data() + r * n, m_direction.data(), n);
+		axpy(m_alpha[r] - beta, m_s.data() + r * n, m_direction.data(), n);
+	}
+
+	for(auto &d: m_direction)
+		d = -d;
+}
+
+bool LBFGS::step()
+{
+	const size_t n = m_gradient.size();
+	auto &parameters = m_network.parameters();
+
+	double largest_differential = 0.0;
+	for(auto g: m_gradient)
+		largest_differential = std::max(largest_differential, std::abs(g));
+
+	if(largest_differential < m_settings.gradient_tolerance)
+		return false;
+
+	compute_direction();
+
+	// The approximation may have lost its curvature, the search restarts from the gradient
+	double slope = dot(m_gradient.data(), m_direction.data(), n);
+	if(slope >= 0.0)
+	{
+		m_pair_count = 0;
+		compute_direction();
+		slope = dot(m_gradient.data(), m_direction.data(), n);
+	}
+
+	std::copy(parameters.begin(), parameters.end(), m_start.begin());
+
+	// Backtracking: the step is replaced by the minimum of the quadratic through the loss, its slope at 0 and
+	// the last trial, kept within [0.1, 0.5] times the previous one
+	double t = 1.0;
+	double trial_loss = 0.0;
+	bool accepted = false;
+	for(size_t i = 0; i < m_settings.max_line_search_steps && !accepted; ++i)
+	{
+		for(size_t j = 0; j < n; ++j)
+			parameters[j] = m_start[j] + t * m_direction[j];
+
+		trial_loss = evaluate(m_trial_gradient);
+		accepted = std::isfinite(trial_loss) && trial_loss <= m_loss + m_settings.armijo * t * slope;
+
+		if(!accepted)
+		{
+			double minimum = -slope * t * t / (2.0 * (trial_loss - m_loss - slope * t));
+			t = std::isfinite(minimum) ? std::clamp(minimum, 0.1 * t, 0.5 * t): 0.5 * t;
+		}
+	}
+
+	if(!accepted)
+	{
+		std::copy(m_start.begin(), m_start.end(), parameters.begin());
+
+		// Gives the gradient direction one more chance
+		bool had_pairs = m_pair_count > 0;
+		m_pair_count = 0;
+		return had_pairs;
+	}
+
+	// s = t * d, y = change of the gradient, written directly into the next row of the ring
+	size_t r = (m_newest + 1) % m_settings.history;
+	double *s = m_s.data() + r * n;
+	double *y = m_y.data() + r * n;
+	for(size_t j = 0; j < n; ++j)
+	{
+		s[j] = t * m_direction[j];
+		y[j] = m_trial_gradient[j] - m_gradient[j];
+	}
+
+	double sy = dot(s, y, n);
+	if(sy > curvature_epsilon * std::sqrt(dot(s, s, n) * dot(y, y, n)))
+	{
+		m_rho[r] = 1.0 / sy;
+		m_newest = r;
+		m_pair_count = std::min(m_pair_count + 1, m_settings.history);
+	}
+	else if(m_pair_count == m_settings.history)
+	{
+		// The row held the oldest pair
+		--m_pair_count;
+	}
+
+	std::swap(m_gradient, m_trial_gradient);
+	m_loss = trial_loss;
+
+	return true;
+}
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "dense_net.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+struct LBFGSSettings
+{
+	// Number of curvature pairs kept
+	size_t history = 10;
+
+	// Sufficient decrease constant of the line search (Armijo condition)
+	double armijo = 1e-4;
+
+	// Loss evaluations tried by one line search before giving up
+	size_t max_line_search_steps = 20;
+
+	// step() returns false once every differential is below this
+	double gradient_tolerance = 1e-6;
+
+	// Samples given to one DenseNet::gradient call, the chunks are evaluated in parallel
+	size_t chunk_size = 1000;
+
+	// 0 means std::thread::hardware_concurrency()
+	unsigned thread_count = 0;
+};
+
+/**
+ * @brief Full batch L-BFGS over the parameters of a DenseNet, minimizing the mean cross entropy over a whole
+ * training set. Each evaluation of the loss and its gradient is split into chunks of samples run in parallel,
+ * their gradients are summed in a fixed order so the result doesn't depend on the number of threads.
+ * The curvature pairs are kept in two contiguous ring buffers
+ *
+ */
+class LBFGS
+{
+public:
+	/**
+	 * @brief Evaluates the loss at the current parameters
+	 *
+	 * @param network Its parameters are optimized in place, must outlive the optimizer
+	 * @param inputs sample_count x input size, row-major, must outlive the optimizer
+	 * @param labels
+	 * @param sample_count
+	 * @param settings
+	 */
+	LBFGS(DenseNet &network, const double *inputs, const uint32_t *labels, size_t sample_count, const LBFGSSettings &settings = LBFGSSettings());
+
+	/**
+	 * @brief One iteration: a direction from the two-loop recursion, then a backtracking line search along it
+	 *
+	 * @return false if the gradient vanished or no step decreased the loss, the parameters are then unchanged
+	 */
+	bool step();
+
+	// Mean loss at the current parameters
+	inline double loss() const { return m_loss; }
+
+	// Number of full batch evaluations so far
+	inline size_t evaluations() const { return m_evaluations; }
+
+private:
+	// Mean loss at the network's current parameters, its gradient is written to gradient
+	double evaluate(std::vector<double> &gradient);
+
+	// Replaces m_direction by -H * m_gradient, H approximating the inverse of the hessian
+	void compute_direction();
+
+	DenseNet &m_network;
+	const double *m_inputs;
+	const uint32_t *m_labels;
+	size_t m_sample_count;
+	LBFGSSettings m_settings;
+
+	double m_loss = 0.0;
+	size_t m_evaluations = 0;
+	std::vector<double> m_gradient;
+
+	// Pair i (oldest first) is at row (m_newest + 1 + i + history - m_pair_count) % history
+	std::vector<double> m_s;
+	std::vector<double> m_y;
+	std::vector<double> m_rho;
+	std::vector<double> m_alpha;
+	size_t m_pair_count = 0;
+	size_t m_newest = 0;
+
+	// Reused by every step
+	std::vector<double> m_direction;
+	std::vector<double> m_start;
+	std::vector<double> m_trial_gradient;
+
+	// Gradient and loss of each chunk
+	std::vector<double> m_partial_gradients;
+	std::vector<double> m_partial_losses;
+};
+
+} // namespace NN
\ No newline at end of file
@@ -4,9 +4,27 @@
 #include "optimizer.hpp"
 #include "utils.hpp"
 #include "img_data.hpp"
+#include "dense_net.hpp"
+#include "quantized_net.hpp"
+#include "sparse_net.hpp"
+#include "sweep.hpp"
+#include "checkpoint.hpp"
+#include "distributed.hpp"
+#include "augment.hpp"
+#include "importance_sampler.hpp"
+#include "evaluator.hpp"
+#include "pipeline.hpp"
+#include "lbfgs.hpp"
+#include "distillation.hpp"
+#include "checks.hpp"
+#include "static_net.hpp"
 #include <chrono>
+#include <fstream>
+#include <string>
 #include <cmath>
 #include <iostream>
+#include <algorithm>
+#include <memory>
 
 int find_prediction(const std::vector<CG::Value> &y_pred )
 {
@@ -25,14 +43,472 @@ int find_prediction(const std::vector<CG::Value> &y_pred )
 	return max_index;
 }
 
-void train_and_save_nn()
+// Same as find_prediction, for the flat outputs of NN::DenseNet
+double batch_accuracy(const std::vector<double> &outputs, const std::vector<uint32_t> &labels, size_t output_size)
+{
+	double correct_guess = 0.0;
+	for(size_t i = 0; i < labels.size(); ++i)
+	{
+		auto first = outputs.begin() + i * output_size;
+		if(std::max_element(first, first + output_size) - first == labels[i])
+			correct_guess += 1.0;
+	}
+
+	return correct_guess / (double)labels.size();
+}
+
+void quantize_nn(const std::string &weights_path)
+{
+	size_t calibration_size = 1000;
+
+	NN::NeuralNet neural_net;
+	if(!neural_net.load_weights(weights_path))
+		return;
+
+	auto [X_train, y_train] = load_mnist_digits_train();
+	auto [X_test, y_test] = load_mnist_digits_test();
+	auto permutation = generate_permutation(X_train.size());
+
+	// Calibrate the activation ranges on a random subset of the training set
+	std::vector<double> calibration;
+	for(size_t i = 0; i < calibration_size; ++i)
+	{
+		const auto &sample = X_train[permutation[i]];
+		calibration.insert(calibration.end(), sample.begin(), sample.end());
+	}
+
+	NN::DenseNet dense_net(neural_net);
+	NN::QuantizedNet quantized_net(dense_net, calibration.data(), calibration_size);
+
+	auto inputs = flatten_samples(X_test, 0, X_test.size());
+
+	auto start = std::chrono::steady_clock::now();
+	auto float_outputs = dense_net.forward(inputs.data(), X_test.size());
+	auto middle = std::chrono::steady_clock::now();
+	auto int8_outputs = quantized_net.forward(inputs.data(), X_test.size());
+	auto end = std::chrono::steady_clock::now();
+
+	double float_accuracy = batch_accuracy(float_outputs, y_test, dense_net.output_size());
+	double int8_accuracy = batch_accuracy(int8_outputs, y_test, dense_net.output_size());
+
+	std::cout << "Float accuracy: " << float_accuracy * 100 << "% in " << std::chrono::duration<double>(middle - start).count() << "s" << std::endl;
+	std::cout << "Int8 accuracy: " << int8_accuracy * 100 << "% in " << std::chrono::duration<double>(end - middle).count() << "s" << std::endl;
+	std::cout << "Accuracy delta: " << (int8_accuracy - float_accuracy) * 100 << "%" << std::endl;
+	std::cout << "Parameters: " << dense_net.parameter_count() * sizeof(double) << " bytes -> " << quantized_net.parameter_bytes() << " bytes" << std::endl;
+}
+
+// Fine-tunes saved weights while pruning them, then compares the dense network with the pruned one evaluated
+// by the sparse kernels
+void prune_nn(const std::string &weights_path)
+{
+	int batch_size = 32;
+	NN::PruningSchedule schedule;
+
+	// Some steps at the final sparsity let the network recover from the last pruning
+	size_t steps = schedule.end_step + 200;
+
+	// The dense baseline gets the same fine-tuning without the pruning, so that both come from the same training
+	NN::NeuralNet neural_net, dense_baseline;
+	if(!neural_net.load_weights(weights_path) || !dense_baseline.load_weights(weights_path))
+		return;
+
+	auto [X_train, y_train] = load_mnist_digits_train();
+	auto [X_test, y_test] = load_mnist_digits_test();
+	auto permutation = generate_permutation(X_train.size());
+	auto inputs = flatten_samples(X_test, 0, X_test.size());
+
+	auto fine_tune = [&](NN::NeuralNet &network, bool prune) {
+		NN::Optimizer optimizer(network, 1, 0.9);
+
+		for(size_t step = 0; step < steps; ++step)
+		{
+			optimizer.zero_grad();
+
+			for(int i = 0; i < batch_size; ++i)
+			{
+				size_t index = permutation[(step*batch_size+i)%X_train.size()];
+				optimizer.accumulate(X_train[index], y_train[index]);
+			}
+
+			optimizer.step();
+
+			if(prune && schedule.prunes_at(step))
+				network.prune(schedule.sparsity(step));
+		}
+	};
+
+	fine_tune(dense_baseline, false);
+	fine_tune(neural_net, true);
+
+	neural_net.save_weights("pruned.txt");
+	NN::DenseNet dense_net(dense_baseline);
+	NN::DenseNet pruned_dense_net(neural_net);
+	NN::SparseNet sparse_net{pruned_dense_net};
+
+	auto time_forward = [&](const auto &network, std::vector<double> &outputs) {
+		auto start = std::chrono::steady_clock::now();
+		outputs = network.forward(inputs.data(), X_test.size());
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	std::vector<double> dense_outputs, pruned_dense_outputs, sparse_outputs;
+	double dense_seconds = time_forward(dense_net, dense_outputs);
+	double pruned_dense_seconds = time_forward(pruned_dense_net, pruned_dense_outputs);
+	double sparse_seconds = time_forward(sparse_net, sparse_outputs);
+
+	double dense_accuracy = batch_accuracy(dense_outputs, y_test, dense_net.output_size());
+	double sparse_accuracy = batch_accuracy(sparse_outputs, y_test, dense_net.output_size());
+
+	std::cout << "Sparsity: " << neural_net.sparsity() * 100 << "%" << std::endl;
+	std::cout << "Dense accuracy: " << dense_accuracy * 100 << "% in " << dense_seconds << "s" << std::endl;
+	std::cout << "Sparse accuracy: " << sparse_accuracy * 100 << "% in " << sparse_seconds << "s" << std::endl;
+	std::cout << "Pruned weights with the dense kernels: " << batch_accuracy(pruned_dense_outputs, y_test, dense_net.output_size()) * 100
+		<< "% in " << pruned_dense_seconds << "s" << std::endl;
+	std::cout << "Parameters: " << dense_net.parameter_count() * sizeof(double) << " bytes -> " << sparse_net.parameter_bytes() << " bytes" << std::endl;
+}
+
+// Trains the same network twice, drawing the samples uniformly then with an ImportanceSampler, and reports how
+// many steps each needed to reach target_accuracy on the test set
+void compare_samplers(double target_accuracy)
+{
+	int steps = 2000;
+	int batch_size = 32;
+	int test_size = 1000;
+	int test_every = 10;
+	uint32_t seed = NN::random_seed();
+
+	auto [X_train, y_train] = load_mnist_digits_train();
+	auto [X_test, y_test] = load_mnist_digits_test();
+	auto test_inputs = flatten_samples(X_test, 0, test_size);
+	std::vector<uint32_t> test_labels(y_test.begin(), y_test.begin() + test_size);
+
+	for(bool importance: {false, true})
+	{
+		NN::NeuralNet neural_net({
+			NN::linear(28*28, 16),
+			NN::relu(),
+			NN::linear(16, 10),
+			NN::softmax()
+		}, seed);
+
+		NN::Optimizer optimizer(neural_net, 1, 0.9);
+		NN::ImportanceSampler sampler(X_train.size(), NN::ImportanceSettings(), seed);
+		auto permutation = generate_permutation(X_train.size());
+
+		std::vector<uint32_t> indices(batch_size);
+		std::vector<double> weights(batch_size, 1.0);
+
+		int reached = -1;
+		double accuracy = 0.0;
+		for(int step = 0; step < steps && reached < 0; ++step)
+		{
+			if(importance)
+				sampler.sample(batch_size, indices, weights);
+			else
+			{
+				for(int i = 0; i < batch_size; ++i)
+					indices[i] = permutation[(step*batch_size+i)%X_train.size()];
+			}
+
+			optimizer.zero_grad();
+
+			// The losses of the forward passes keep the estimates of the sampler up to date
+			for(int i = 0; i < batch_size; ++i)
+			{
+				double loss = optimizer.accumulate(X_train[indices[i]], y_train[indices[i]], weights[i]);
+				sampler.update(indices[i], loss);
+			}
+
+			optimizer.step();
+
+			if((step+1) % test_every != 0)
+				continue;
+
+			NN::DenseNet dense_net(neural_net);
+			accuracy = batch_accuracy(dense_net.forward(test_inputs.data(), test_size), test_labels, dense_net.output_size());
+			if(accuracy >= target_accuracy)
+				reached = step+1;
+		}
+
+		std::cout << (importance ? "Importance sampling: ": "Uniform sampling: ");
+		if(reached >= 0)
+			std::cout << target_accuracy * 100 << "% accuracy after " << reached << " steps" << std::endl;
+		else
+			std::cout << accuracy * 100 << "% accuracy after " << steps << " steps" << std::endl;
+	}
+}
+
+// Trains a deeper network with its layers split into stage_count pipeline stages, each on its own thread,
+// and compares the time of a pipelined gradient with a single threaded one
+void train_pipelined(size_t stage_count)
+{
+	int steps = 500;
+	size_t batch_size = 64;
+	size_t micro_batch_size = 8;
+	double learning_rate = 0.05;
+	double momentum = 0.9;
+
+	NN::NeuralNet neural_net({
+		NN::linear(28*28, 128, NN::Layer::Init::HE),
+		NN::relu(),
+		NN::linear(128, 128, NN::Layer::Init::HE),
+		NN::relu(),
+		NN::linear(128, 64, NN::Layer::Init::HE),
+		NN::relu(),
+		NN::linear(64, 10, NN::Layer::Init::XAVIER),
+		NN::softmax()
+	});
+
+	auto [X_train, y_train] = load_mnist_digits_train();
+	auto [X_test, y_test] = load_mnist_digits_test();
+	auto permutation = generate_permutation(X_train.size());
+	auto test_inputs = flatten_samples(X_test, 0, X_test.size());
+
+	NN::DenseNet dense_net(neural_net);
+	NN::PipelinedNet pipeline(dense_net, stage_count, micro_batch_size);
+	auto &parameters = dense_net.parameters();
+
+	std::vector<double> gradient(parameters.size());
+	std::vector<double> velocity(parameters.size(), 0.0);
+	std::vector<double> inputs;
+	std::vector<uint32_t> labels(batch_size);
+	double pipelined_seconds = 0.0;
+	double sequential_seconds = 0.0;
+
+	for(int step = 0; step < steps; ++step)
+	{
+		inputs.clear();
+		for(size_t i = 0; i < batch_size; ++i)
+		{
+			size_t index = permutation[(step*batch_size+i)%X_train.size()];
+			inputs.insert(inputs.end(), X_train[index].begin(), X_train[index].end());
+			labels[i] = y_train[index];
+		}
+
+		// Same gradient computed on one thread, only timed
+		std::fill(gradient.begin(), gradient.end(), 0.0);
+		auto start = std::chrono::steady_clock::now();
+		dense_net.gradient(inputs.data(), labels.data(), batch_size, gradient.data());
+		auto middle = std::chrono::steady_clock::now();
+
+		std::fill(gradient.begin(), gradient.end(), 0.0);
+		pipeline.gradient(inputs.data(), labels.data(), batch_size, gradient.data());
+		auto end = std::chrono::steady_clock::now();
+
+		sequential_seconds += std::chrono::duration<double>(middle - start).count();
+		pipelined_seconds += std::chrono::duration<double>(end - middle).count();
+
+		for(size_t i = 0; i < parameters.size(); ++i)
+		{
+			velocity[i] = momentum * velocity[i] + gradient[i] / (double)batch_size;
+			parameters[i] -= learning_rate * velocity[i];
+		}
+	}
+
+	double accuracy = batch_accuracy(pipeline.forward(test_inputs.data(), X_test.size()), y_test, dense_net.output_size());
+
+	std::cout << "Stages start at layers:";
+	for(auto layer: pipeline.stages())
+		std::cout << " " << layer;
+	std::cout << std::endl;
+
+	std::cout << "Accuracy: " << accuracy * 100 << "%" << std::endl;
+	std::cout << "Gradient time: " << sequential_seconds << "s on one thread, " << pipelined_seconds << "s pipelined" << std::endl;
+}
+
+// Trains a network with full batch L-BFGS, every evaluation of the loss using the whole training set
+void train_lbfgs(int iterations)
+{
+	int test_every = 10;
+
+	NN::NeuralNet neural_net({
+		NN::linear(28*28, 16, NN::Layer::Init::HE),
+		NN::relu(),
+		NN::linear(16, 10, NN::Layer::Init::XAVIER),
+		NN::softmax()
+	});
+
+	auto [X_train, y_train] = load_mnist_digits_train();
+	auto [X_test, y_test] = load_mnist_digits_test();
+	auto train_inputs = flatten_samples(X_train, 0, X_train.size());
+	auto test_inputs = flatten_samples(X_test, 0, X_test.size());
+
+	NN::DenseNet dense_net(neural_net);
+	NN::LBFGS optimizer(dense_net, train_inputs.data(), y_train.data(), y_train.size());
+
+	auto start = std::chrono::steady_clock::now();
+	for(int iteration = 0; iteration < iterations; ++iteration)
+	{
+		bool progressed = optimizer.step();
+
+		if(progressed && iteration % test_every != 0 && iteration + 1 < iterations)
+			continue;
+
+		double accuracy = batch_accuracy(dense_net.forward(test_inputs.data(), X_test.size()), y_test, dense_net.output_size());
+
+		std::cout << "-------------------" << std::endl;
+		std::cout << "Iteration " << iteration << " / " << iterations << std::endl;
+		std::cout << "Training loss: " << optimizer.loss() << " after " << optimizer.evaluations() << " evaluations, "
+			<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+		std::cout << "Accuracy: " << accuracy * 100 << "%" << std::endl;
+
+		if(!progressed)
+			break;
+	}
+
+	dense_net.store(neural_net);
+	neural_net.save_weights("out.txt");
+}
+
+// Mean time to evaluate one sample alone, like a request the server can't batch, in microseconds
+double latency_us(const NN::DenseNet &network, const std::vector<double> &inputs, size_t sample_count)
+{
+	const size_t input_size = network.input_size();
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < sample_count; ++i)
+		network.forward(inputs.data() + i * input_size, 1);
+	auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::micro>(end - start).count() / (double)sample_count;
+}
+
+// Distills the network saved in teacher_path into a student with one hidden layer of each given width, and
+// compares their accuracy and latency with the teacher's
+void distill_nn(const std::string &teacher_path, const std::vector<int> &student_widths)
+{
+	size_t latency_samples = 1000;
+	NN::DistillationSettings settings;
+
+	NN::NeuralNet teacher_net;
+	if(!teacher_net.load_weights(teacher_path))
+		return;
+
+	auto [X_train, y_train] = load_mnist_digits_train();
+	auto [X_test, y_test] = load_mnist_digits_test();
+	auto train_inputs = flatten_samples(X_train, 0, X_train.size());
+	auto test_inputs = flatten_samples(X_test, 0, X_test.size());
+
+	// The teacher's softened outputs are computed once for the whole training set
+	NN::DenseNet teacher(teacher_net);
+	auto targets = NN::soft_targets(teacher, train_inputs.data(), X_train.size(), settings.temperature);
+
+	auto report = [&](const std::string &name, const NN::DenseNet &network) {
+		double accuracy = batch_accuracy(network.forward(test_inputs.data(), X_test.size()), y_test, network.output_size());
+
+		std::cout << name << ": " << accuracy * 100 << "% accuracy, " << latency_us(network, test_inputs, latency_samples)
+			<< "us per sample, " << network.parameter_count() << " parameters" << std::endl;
+	};
+
+	report("Teacher", teacher);
+
+	for(int width: student_widths)
+	{
+		NN::NeuralNet student_net({
+			NN::linear(28*28, width, NN::Layer::Init::HE),
+			NN::relu(),
+			NN::linear(width, 10, NN::Layer::Init::XAVIER),
+			NN::softmax()
+		});
+
+		NN::DenseNet student(student_net);
+		NN::distill(student, train_inputs.data(), y_train.data(), targets.data(), X_train.size(), settings);
+
+		report("Student " + std::to_string(width), student);
+
+		student.store(student_net);
+		student_net.save_weights("student_" + std::to_string(width) + ".txt");
+	}
+}
+
+// The architecture trained by default, fixed at compile time
+using StaticMnistNet = NN::StaticNet<NN::Linear<28*28, 16>, NN::ReLU, NN::Linear<16, 10>, NN::Softmax>;
+
+// Evaluates saved weights with a StaticNet and with a DenseNet, and compares their accuracy and latency
+void static_nn(const std::string &weights_path)
+{
+	size_t latency_samples = 1000;
+
+	auto static_net = std::make_unique<StaticMnistNet>();
+	if(!static_net->load_weights(weights_path))
+	{
+		std::cout << "Expected the weights of a 784-16-10 network in " << weights_path << std::endl;
+		return;
+	}
+
+	NN::NeuralNet neural_net;
+	neural_net.load_weights(weights_path);
+	NN::DenseNet dense_net(neural_net);
+
+	auto [X_test, y_test] = load_mnist_digits_test();
+	auto test_inputs = flatten_samples(X_test, 0, X_test.size());
+
+	std::vector<double> static_outputs;
+	static_outputs.reserve(X_test.size() * StaticMnistNet::output_size);
+	for(const auto &sample: X_test)
+	{
+		StaticMnistNet::Input input;
+		std::copy(sample.begin(), sample.end(), input.begin());
+
+		auto output = static_net->forward(input);
+		static_outputs.insert(static_outputs.end(), output.begin(), output.end());
+	}
+
+	auto dense_outputs = dense_net.forward(test_inputs.data(), X_test.size());
+
+	double max_difference = 0.0;
+	for(size_t i = 0; i < dense_outputs.size(); ++i)
+		max_difference = std::max(max_difference, std::fabs(dense_outputs[i] - static_outputs[i]));
+
+	// One sample at a time, like latency_us
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < latency_samples; ++i)
+	{
+		StaticMnistNet::Input input;
+		std::copy_n(test_inputs.begin() + i * StaticMnistNet::input_size, StaticMnistNet::input_size, input.begin());
+		static_net->forward(input);
+	}
+	auto end = std::chrono::steady_clock::now();
+	double static_latency = std::chrono::duration<double, std::micro>(end - start).count() / (double)latency_samples;
+
+	std::cout << "DenseNet: " << batch_accuracy(dense_outputs, y_test, dense_net.output_size()) * 100 << "% accuracy, "
+		<< latency_us(dense_net, test_inputs, latency_samples) << "us per sample" << std::endl;
+	std::cout << "StaticNet: " << batch_accuracy(static_outputs, y_test, StaticMnistNet::output_size) * 100 << "% accuracy, "
+		<< static_latency << "us per sample" << std::endl;
+	std::cout << "Largest output difference: " << max_difference << std::endl;
+}
+
+void sweep_nn(size_t random_count)
+{
+	auto [X_train, y_train] = load_mnist_digits_train();
+	auto [X_test, y_test] = load_mnist_digits_test();
+
+	NN::SweepSpace space;
+	auto configs = random_count > 0 ? NN::random_search(space, random_count): NN::grid_search(space);
+
+	auto results = NN::run_sweep(configs, X_train, y_train, X_test, y_test);
+	NN::print_sweep_results(results, std::cout);
+}
+
+// One process of a data parallel training: each process trains on its own part of the permutation,
+// and the gradients are averaged over the ring before every step
+void train_data_parallel(
+	int rank,
+	int world_size,
+	const std::string &next_host,
+	const std::vector<std::vector<double>> &X_train,
+	const std::vector<uint32_t> &y_train,
+	const std::vector<std::vector<double>> &X_test,
+	const std::vector<uint32_t> &y_test
+)
 {
 	int epochs = 10;
 	int batch_size = 32;
-	int test_size = 100;
+	int test_size = 1000;
 	int test_every = 10;
-	int current_test_id = 0;
-	
+
+	NN::RingAllReduce ring(rank, world_size, next_host);
+
 	NN::NeuralNet neural_net({
 		NN::linear(28*28, 16),
 		NN::relu(),
@@ -40,67 +516,210 @@ void train_and_save_nn()
 		NN::softmax()
 	});
 
+	// Every process starts from the same parameters, and stays in sync since they apply the same gradients
+	NN::broadcast_parameters(neural_net, ring);
 	NN::Optimizer optimizer(neural_net, 1, 0.9);
 
-	auto [X_train, y_train] = load_mnist_digits_train();
-	auto [X_test, y_test] = load_mnist_digits_test();
 	auto permutation = generate_permutation(X_train.size());
+	auto test_inputs = flatten_samples(X_test, 0, test_size);
+	std::vector<uint32_t> test_labels(y_test.begin(), y_test.begin() + test_size);
 
 	for(int epoch = 0; epoch < epochs; ++epoch)
 	{
 		optimizer.zero_grad();
-		
+
 		for(int i = 0; i < batch_size; ++i)
 		{
-			// Forward Pass
-			size_t index = permutation[(epoch*batch_size+i)%X_train.size()];
-			std::vector<CG::Value> logits = neural_net.forward(X_train[index]);
-
-			// Loss function
-			CG::Value loss = CG::cross_entropy(y_train[index], logits);
-
-			// Gradient calculation
+			size_t index = permutation[((epoch * world_size + rank) * batch_size + i) % X_train.size()];
+			CG::Value loss = CG::cross_entropy(y_train[index], neural_net.forward(X_train[index]));
 			loss->backprop();
-
-			// Accumulate the loss of multiple values
 			optimizer.accumulate(loss);
 		}
 
-		// Gradient descent step
+		NN::average_gradients(neural_net, ring);
 		optimizer.step();
 
-		if(epoch % test_every != 0)
+		if(rank != 0 || epoch % test_every != 0)
 			continue;
 
-		// Test
-		double error = 0.0;
-		double correct_guess = 0.0;
-		for(int i = 0; i < test_size; ++i)
+		NN::DenseNet dense_net(neural_net);
+		double accuracy = batch_accuracy(dense_net.forward(test_inputs.data(), test_size), test_labels, dense_net.output_size());
+
+		std::cout << "-------------------" << std::endl;
+		std::cout << "Epoch " << epoch << " / " << epochs << " (" << world_size << " processes)" << std::endl;
+		std::cout << "Accuracy: " << accuracy * 100 << "%" << std::endl;
+	}
+
+	if(rank == 0)
+		neural_net.save_weights("out.txt");
+}
+
+// When checkpoint_path isn't empty, the training state is saved there every few epochs and the training
+// resumes from it if it exists. With augment, the batches are randomly distorted by an AugmentedBatchLoader
+void train_and_save_nn(const std::string &checkpoint_path = "", bool augment = false)
+{
+	const std::string dataset_directory = "../dataset/";
+	int epochs = 10;
+	int batch_size = 32;
+	int test_every = 1;
+	int checkpoint_every = 5;
+
+	NN::NeuralNet neural_net({
+		NN::linear(28*28, 16),
+		NN::relu(),
+		NN::linear(16, 10),
+		NN::softmax()
+	});
+
+	bool resume = !checkpoint_path.empty() && std::ifstream(checkpoint_path).good();
+	if(resume && !neural_net.load_weights(checkpoint_path))
+		return;
+
+	NN::Optimizer optimizer(neural_net, 1, 0.9);
+
+	size_t first_epoch = 0;
+	if(resume)
+	{
+		if(!NN::CheckpointWriter::restore(checkpoint_path, optimizer, first_epoch))
+			return;
+
+		std::cout << "Resuming from epoch " << first_epoch << std::endl;
+	}
+
+	const auto &plan = optimizer.memory_plan();
+	std::cout << "Training workspace: " << plan.bytes() << " bytes, " << plan.slot_count << " slots for "
+		<< plan.register_count << " nodes (" << plan.unplanned_bytes() << " bytes without planning)" << std::endl;
+
+	std::unique_ptr<NN::CheckpointWriter> checkpoint;
+	if(!checkpoint_path.empty())
+		checkpoint = std::make_unique<NN::CheckpointWriter>(optimizer, checkpoint_path);
+
+	auto [X_train, y_train] = load_mnist_digits_train(dataset_directory);
+	auto [X_test, y_test] = load_mnist_digits_test(dataset_directory);
+	auto permutation = generate_permutation(X_train.size());
+
+	std::unique_ptr<AugmentedBatchLoader> loader;
+	std::vector<Image> train_images;
+	if(augment)
+	{
+		// One batch per epoch, a resumed training continues the stream where the checkpoint left it
+		train_images = load_images(dataset_directory + "train-images.idx3-ubyte");
+		loader = std::make_unique<AugmentedBatchLoader>(train_images, y_train, AugmentParams(), batch_size, 2, 4, 0, first_epoch);
+	}
+
+	// The whole test set is evaluated on its own thread, while the training goes on
+	NN::BackgroundEvaluator evaluator(neural_net, flatten_samples(X_test, 0, X_test.size()), y_test);
+	std::vector<double> gradient_norms(epochs);
+
+	auto print_evaluations = [&]() {
+		for(const auto &evaluation: evaluator.results())
 		{
-			auto y_pred = neural_net.forward(X_test[current_test_id]);
-			auto y_real = y_test[current_test_id];
-			auto prediction = find_prediction(y_pred);
+			std::cout << "-------------------" << std::endl;
+			std::cout << "Epoch " << evaluation.step << " / " << epochs << std::endl;
+			std::cout << "Mean error: " << evaluation.mean_loss << std::endl;
+			std::cout << "Accuracy: " << evaluation.accuracy * 100 << "%" << std::endl;
+			std::cout << "Gradient L2 norm: " << gradient_norms[evaluation.step] << std::endl;
+		}
+	};
 
-			if(static_cast<int>(y_real) == prediction)
-				correct_guess += 1.0;
+	for(int epoch = first_epoch; epoch < epochs; ++epoch)
+	{
+		optimizer.zero_grad();
 
-			double err = CG::cross_entropy(y_real, y_pred)->value();
-			error += err;
-			current_test_id = (++current_test_id) % X_test.size();
+		if(loader)
+		{
+			// Distorted on the loader's threads while the previous batches were trained on
+			Batch batch = loader->next();
+			for(size_t i = 0; i < batch.inputs.size(); ++i)
+				optimizer.accumulate(batch.inputs[i], batch.labels[i]);
+		}
+		else
+		{
+			for(int i = 0; i < batch_size; ++i)
+			{
+				// Forward pass, cross entropy loss and gradient calculation in the optimizer's planned workspace
+				size_t index = permutation[(epoch*batch_size+i)%X_train.size()];
+				optimizer.accumulate(X_train[index], y_train[index]);
+			}
 		}
 
-		std::cout << "-------------------" << std::endl;
-		std::cout << "Epoch " << epoch << " / " << epochs << std::endl;
-		std::cout << "Mean error: " << error / (double)test_size<< std::endl;
-		std::cout << "Accuracy: " << (correct_guess / (double)test_size)*100 << "%" <<std::endl;
-		std::cout << "Gradient L2 norm: " << optimizer.grad_l2_norm() << std::endl;
+		// Gradient descent step
+		optimizer.step();
+
+		if(checkpoint && (epoch+1) % checkpoint_every == 0)
+			checkpoint->snapshot(epoch+1);
+
+		if(epoch % test_every == 0)
+		{
+			gradient_norms[epoch] = optimizer.grad_l2_norm();
+			evaluator.snapshot(epoch);
+		}
+
+		print_evaluations();
 	}
 
+	evaluator.flush();
+	print_evaluations();
+
+	if(evaluator.skipped() > 0)
+		std::cout << evaluator.skipped() << " snapshots were replaced before being evaluated" << std::endl;
+
 	neural_net.save_weights("out.txt");
 }
 
-int main()
+int main(int argc, char **argv)
 {
-	train_and_save_nn();
+	std::string mode = argc > 1 ? argv[1]: "train";
+
+	if(mode == "quantize" && argc > 2)
+		quantize_nn(argv[2]);
+	else if(mode == "prune" && argc > 2)
+		prune_nn(argv[2]);
+	else if(mode == "train" && argc > 2)
+		train_and_save_nn(argv[2]);
+	else if(mode == "augment")
+		train_and_save_nn(argc > 2 ? argv[2]: "", true);
+	else if(mode == "distributed" && argc > 2)
+	{
+		// Loaded before forking, so that the processes share the dataset's pages
+		auto [X_train, y_train] = load_mnist_digits_train();
+		auto [X_test, y_test] = load_mnist_digits_test();
+
+		int world_size = std::stoi(argv[2]);
+		int rank = NN::fork_workers(world_size);
+		train_data_parallel(rank, world_size, "127.0.0.1", X_train, y_train, X_test, y_test);
+
+		if(rank == 0 && !NN::wait_workers())
+			return 1;
+	}
+	else if(mode == "worker" && argc > 3)
+	{
+		auto [X_train, y_train] = load_mnist_digits_train();
+		auto [X_test, y_test] = load_mnist_digits_test();
+		train_data_parallel(std::stoi(argv[2]), std::stoi(argv[3]), argc > 4 ? argv[4]: "127.0.0.1", X_train, y_train, X_test, y_test);
+	}
+	else if(mode == "importance")
+		compare_samplers(argc > 2 ? std::stod(argv[2]): 0.85);
+	else if(mode == "pipeline" && argc > 2)
+		train_pipelined(std::stoul(argv[2]));
+	else if(mode == "lbfgs")
+		train_lbfgs(argc > 2 ? std::stoi(argv[2]): 100);
+	else if(mode == "distill" && argc > 2)
+	{
+		std::vector<int> widths;
+		for(int i = 3; i < argc; ++i)
+			widths.push_back(std::stoi(argv[i]));
+
+		distill_nn(argv[2], widths.empty() ? std::vector<int>{32, 16, 8}: widths);
+	}
+	else if(mode == "static" && argc > 2)
+		static_nn(argv[2]);
+	else if(mode == "check")
+		return NN::run_checks(std::cout) ? 0: 1;
+	else if(mode == "sweep")
+		sweep_nn(argc > 2 ? std::stoul(argv[2]): 0);
+	else
+		train_and_save_nn();
+
 	return 0;
 }
\ No newline at end of file
@@ -1,10 +1,16 @@
 #include "neural_network.hpp"
 #include "utils.hpp"
+#include "graph_opt.hpp"
 #include <random>
 #include <fstream>
 #include <iostream>
 #include <cassert>
-#include <ctime>
+#include <tuple>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <limits>
 
 static std::string layer_name(NN::Layer::Func func)
 {
@@ -16,6 +22,10 @@ static std::string layer_name(NN::Layer::Func func)
 		return "sm";
 	case NN::Layer::Func::RELU:
 		return "relu";
+	case NN::Layer::Func::CONV2D:
+		return "conv";
+	case NN::Layer::Func::MAXPOOL2D:
+		return "maxpool";
 	default:
 		assert(false);
 	}
@@ -23,7 +33,7 @@ static std::string layer_name(NN::Layer::Func func)
 	return "";
 }
 
-NN::Layer::Func layer_func(const std::string &str)
+static std::optional<NN::Layer::Func> layer_func(const std::string &str)
 {
 	if(str == "lin") 
 		return NN::Layer::Func::LINEAR;
@@ -31,22 +41,67 @@ NN::Layer::Func layer_func(const std::string &str)
 		return NN::Layer::Func::SOFTMAX;
 	if(str == "relu")
 		return NN::Layer::Func::RELU;
+	if(str == "conv")
+		return NN::Layer::Func::CONV2D;
+	if(str == "maxpool")
+		return NN::Layer::Func::MAXPOOL2D;
 
-	assert(false);
-	return NN::Layer::Func::LINEAR;
+	return std::nullopt;
 }
 
 namespace NN 
 {
 
-Layer linear(int input_size, int output_size)
+// The parameters are drawn by chunks, each with its own engine, so that they don't depend on the number of threads
+constexpr size_t init_chunk_size = 4096;
+
+Layer linear(int input_size, int output_size, Layer::Init init)
 {
 	Layer ret;
 
 	ret.input_size = input_size;
 	ret.output_size = output_size;
 	ret.operation = Layer::Func::LINEAR;
+	ret.init = init;
+
+	return ret;
+}
+
+Layer conv2d(int channels, int height, int width, int out_channels, int kernel, int stride, int padding, Layer::Init init)
+{
+	Layer ret;
+
+	ret.operation = Layer::Func::CONV2D;
+	ret.init = init;
+	ret.channels = channels;
+	ret.height = height;
+	ret.width = width;
+	ret.out_channels = out_channels;
+	ret.kernel = kernel;
+	ret.stride = stride;
+	ret.padding = padding;
+	ret.input_size = channels * height * width;
+	ret.output_size = out_channels * ret.output_height() * ret.output_width();
+
+	assert(ret.output_height() > 0 && ret.output_width() > 0);
+	return ret;
+}
+
+Layer maxpool2d(int channels, int height, int width, int size)
+{
+	Layer ret;
 
+	ret.operation = Layer::Func::MAXPOOL2D;
+	ret.channels = channels;
+	ret.height = height;
+	ret.width = width;
+	ret.out_channels = channels;
+	ret.kernel = size;
+	ret.stride = size;
+	ret.input_size = channels * height * width;
+	ret.output_size = channels * ret.output_height() * ret.output_width();
+
+	assert(ret.output_height() > 0 && ret.output_width() > 0);
 	return ret;
 }
 
@@ -72,12 +127,23 @@ Layer softmax()
 	return ret;
 }
 
-NeuralNet::NeuralNet( const std::initializer_list<Layer> &layer_desc )
+uint32_t random_seed()
+{
+	return std::random_device{}();
+}
+
+NeuralNet::NeuralNet( const std::initializer_list<Layer> &layer_desc, uint32_t seed ):
+	NeuralNet(std::vector<Layer>(layer_desc), seed)
+{
+}
+
+NeuralNet::NeuralNet( const std::vector<Layer> &layer_desc, uint32_t seed )
 {
 	m_architecture = layer_desc;
-	auto [input, output] = construct_tree();
+	auto [input, output] = construct_tree(seed, &m_parameters, &m_layer_outputs);
 	m_input_weights = input;
 	m_output_weights = output;
+	compile();
 }
 
 std::vector<CG::Value> NeuralNet::forward(const std::vector<double> &input)
@@ -91,103 +157,461 @@ std::vector<CG::Value> NeuralNet::forward(const std::vector<double> &input)
 	}
 
 	// Propagate the values forward
-	auto topo_sort = topological_sort(m_output_weights);
-	for(auto it = topo_sort.rbegin(); it != topo_sort.rend(); ++it)
+	m_program.forward();
+
+	if(checkpointing())
 	{
-		it->get()->forward();
+		// The segments are rebuilt from the values of the network's own nodes
+		m_program.store_values();
+		return checkpointed_forward();
 	}
 
 	// We don't want to copy the values of the NeuralNet and let the user of the function
-	// change its weights, so we create a copy of the tree
-	auto [_, output] = construct_tree(false);
-	auto copy_topo_sort = topological_sort(output);
+	// change its weights, so we return a copy of the tree
+	return m_program.clone();
+}
 
-	assert(copy_topo_sort.size() == topo_sort.size());
-	for(size_t i = 0; i < topo_sort.size(); ++i)
+static LayerParameters create_parameters(const Layer &layer, size_t layer_index, std::optional<uint32_t> seed)
+{
+	size_t bias_count = 0;
+	size_t fan_in = 0;
+	size_t fan_out = 0;
+
+	switch(layer.operation)
 	{
-		copy_topo_sort[i]->m_value = topo_sort[i]->m_value;
+	case Layer::Func::LINEAR:
+		bias_count = layer.output_size;
+		fan_in = layer.input_size;
+		fan_out = layer.output_size;
+		break;
+	case Layer::Func::CONV2D:
+		// The filters are shared by every output position
+		bias_count = layer.out_channels;
+		fan_in = layer.channels * layer.kernel * layer.kernel;
+		fan_out = layer.out_channels * layer.kernel * layer.kernel;
+		break;
+	default:
+		return LayerParameters();
 	}
 
-	return output;
-}
+	// The biases, then the weights of each output (or filter) one after the other
+	auto leaves = CG::allocate(bias_count + bias_count * fan_in);
 
-std::pair<std::vector<CG::Value>, std::vector<CG::Value>> NeuralNet::construct_tree(bool random)
-{
-	assert(m_architecture.size() != 0);
-	size_t input_size = m_architecture.begin()->input_size;
+	if(seed)
+	{
+		const double xavier_limit = std::sqrt(6.0 / (fan_in + fan_out));
+		const double he_deviation = std::sqrt(2.0 / fan_in);
+		const size_t chunk_count = (leaves.size() + init_chunk_size - 1) / init_chunk_size;
 
-	// convert the input into CG::Value(s)
-	std::vector<CG::Value> current_activation;
-	current_activation.reserve(input_size);
+		parallel_for(chunk_count, [&](size_t first_chunk, size_t last_chunk) {
+			std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+			std::uniform_real_distribution<double> xavier(-xavier_limit, xavier_limit);
+			std::normal_distribution<double> he(0.0, he_deviation);
 
-	for(size_t i = 0; i < input_size; ++i)
-	{
-		current_activation.push_back(CG::value(0.0));
+			for(size_t chunk = first_chunk; chunk < last_chunk; ++chunk)
+			{
+				std::seed_seq seed_sequence {*seed, static_cast<uint32_t>(layer_index), static_cast<uint32_t>(chunk)};
+				std::mt19937 engine(seed_sequence);
+				he.reset();
+
+				size_t end = std::min(leaves.size(), (chunk + 1) * init_chunk_size);
+				for(size_t i = chunk * init_chunk_size; i < end; ++i)
+				{
+					double &value = leaves[i]->m_value;
+					switch(layer.init)
+					{
+					case Layer::Init::UNIFORM:
+						value = uniform(engine);
+						break;
+					case Layer::Init::XAVIER:
+						value = i < bias_count ? 0.0: xavier(engine);
+						break;
+					case Layer::Init::HE:
+						value = i < bias_count ? 0.0: he(engine);
+						break;
+					}
+				}
+			}
+		});
 	}
 
-	auto input_weights = current_activation;
+	LayerParameters layer_parameters;
+	layer_parameters.biases.assign(leaves.begin(), leaves.begin() + bias_count);
+	layer_parameters.weights.assign(leaves.begin() + bias_count, leaves.end());
 
-	// for each layer, apply its input
-	std::default_random_engine rng;
-	rng.seed(time(NULL));
-	std::uniform_real_distribution<double> distribution(-1.0, 1.0);
-	for(const auto &layer: m_architecture)
+	return layer_parameters;
+}
+
+// Builds the nodes of one layer over current_activation
+static std::vector<CG::Value> apply_layer(
+	const Layer &layer,
+	const std::vector<CG::Value> &current_activation,
+	const LayerParameters &layer_parameters
+)
+{
+	std::vector<CG::Value> layer_output;
+
+	// apply the right operation
+	switch(layer.operation)
+	{
+	case Layer::Func::LINEAR:
 	{
-		std::vector<CG::Value> layer_output;
+		assert((size_t)layer.input_size == current_activation.size());
 
-		// apply the right operation
-		switch(layer.operation)
-		{
-		case Layer::Func::LINEAR:
+		// Same nodes as list_add and operator*, allocated for the whole layer at once
+		layer_output = CG::allocate(layer.output_size);
+		auto products = CG::allocate(layer.output_size * layer.input_size);
+
+		for(int i = 0; i < layer.output_size; ++i)
 		{
-			assert((size_t)layer.input_size == current_activation.size());
-			layer_output.reserve(layer.output_size);
-			for(int i = 0; i < layer.output_size; ++i)
+			// output = bias + sum_i x_i*w_i
+			auto &output = layer_output[i];
+			output->m_op = CG::Op::ADD;
+			output->m_children.reserve(layer.input_size+1);
+			output->m_children.push_back(layer_parameters.biases[i]);
+			output->m_value = layer_parameters.biases[i]->value();
+
+			for(int j = 0; j < layer.input_size; ++j)
 			{
-				// output = bias + sum_i x_i*w_i
-				CG::Value bias = CG::value(random ? distribution(rng): 0.0);
+				const auto &weight = layer_parameters.weights[i * layer.input_size + j];
+				auto &product = products[i * layer.input_size + j];
 
-				std::vector<CG::Value> to_be_added;
-				to_be_added.reserve(layer.input_size+1);
+				product->m_op = CG::Op::MUL;
+				product->m_children = {weight, current_activation[j]};
+				product->m_value = weight->value() * current_activation[j]->value();
 
-				to_be_added.push_back(bias);
-				for(auto &v: current_activation)
+				output->m_children.push_back(product);
+				output->m_value += product->m_value;
+			}
+		}
+
+		break;
+	}
+	case Layer::Func::CONV2D:
+	{
+		assert((size_t)layer.input_size == current_activation.size());
+		const int patch_size = layer.channels * layer.kernel * layer.kernel;
+
+		// Each output is wired to its im2col patch, the taps falling in the padding are omitted
+		layer_output.reserve(layer.output_size);
+		for(int oc = 0; oc < layer.out_channels; ++oc)
+		{
+			for(int oy = 0; oy < layer.output_height(); ++oy)
+			{
+				for(int ox = 0; ox < layer.output_width(); ++ox)
 				{
-					to_be_added.push_back( CG::value(random ? distribution(rng): 0.0) * v);
+					std::vector<CG::Value> to_be_added;
+					to_be_added.reserve(patch_size+1);
+					to_be_added.push_back(layer_parameters.biases[oc]);
+
+					for(int c = 0; c < layer.channels; ++c)
+					for(int ky = 0; ky < layer.kernel; ++ky)
+					for(int kx = 0; kx < layer.kernel; ++kx)
+					{
+						int iy = oy * layer.stride - layer.padding + ky;
+						int ix = ox * layer.stride - layer.padding + kx;
+						if(iy < 0 || iy >= layer.height || ix < 0 || ix >= layer.width)
+							continue;
+
+						const auto &weight = layer_parameters.weights[((oc * layer.channels + c) * layer.kernel + ky) * layer.kernel + kx];
+						to_be_added.push_back(weight * current_activation[(c * layer.height + iy) * layer.width + ix]);
+					}
+
+					layer_output.push_back(CG::list_add(to_be_added));
 				}
-
-				layer_output.push_back(CG::list_add(to_be_added));
 			}
-
-			break;
 		}
-		case Layer::Func::RELU:
+
+		break;
+	}
+	case Layer::Func::MAXPOOL2D:
+	{
+		assert((size_t)layer.input_size == current_activation.size());
+		layer_output.reserve(layer.output_size);
+		for(int c = 0; c < layer.channels; ++c)
 		{
-			layer_output.reserve(current_activation.size());
-			for(const auto &v: current_activation)
+			for(int oy = 0; oy < layer.output_height(); ++oy)
 			{
-				layer_output.push_back(CG::relu(v));
+				for(int ox = 0; ox < layer.output_width(); ++ox)
+				{
+					std::vector<CG::Value> window;
+					window.reserve(layer.kernel * layer.kernel);
+
+					for(int ky = 0; ky < layer.kernel; ++ky)
+					for(int kx = 0; kx < layer.kernel; ++kx)
+					{
+						int iy = oy * layer.stride + ky;
+						int ix = ox * layer.stride + kx;
+						window.push_back(current_activation[(c * layer.height + iy) * layer.width + ix]);
+					}
+
+					layer_output.push_back(CG::max(window));
+				}
 			}
-			break;
 		}
-		case Layer::Func::SOFTMAX:
+
+		break;
+	}
+	case Layer::Func::RELU:
+	{
+		layer_output.reserve(current_activation.size());
+		for(const auto &v: current_activation)
 		{
-			layer_output = CG::softmax(current_activation);
+			layer_output.push_back(CG::relu(v));
+		}
+		break;
+	}
+	case Layer::Func::SOFTMAX:
+	{
+		layer_output = CG::softmax(current_activation);
+		break;
+		default:
+			assert(false);
 			break;
-			default:
-				assert(false);
-				break;
+	}
+	}
+
+	return layer_output;
+}
+
+/**
+ * @brief Layers [first_layer, last_layer) of a forward pass in checkpointing mode. Only the values of their inputs
+ * (the children of the segment) are kept, the nodes in between are rebuilt over the network's own parameters
+ * when the differentials reach the segment
+ * 
+ */
+class LayerSegment: public CG::Segment
+{
+public:
+	LayerSegment(const NeuralNet &network, size_t first_layer, size_t last_layer):
+		m_network(network), m_first_layer(first_layer), m_last_layer(last_layer)
+	{
+	}
+
+	void backward_segment() override
+	{
+		// Recompute the layers from the stored values
+		std::vector<::CG::Value> inputs;
+		inputs.reserve(m_children.size());
+		for(const auto &child: m_children)
+			inputs.push_back(::CG::value(child->value()));
+
+		auto current_activation = inputs;
+		for(size_t i = m_first_layer; i < m_last_layer; ++i)
+		{
+			current_activation = apply_layer(m_network.architecture()[i], current_activation, m_network.parameters()[i]);
 		}
+
+		assert(current_activation.size() == m_output_diffs.size());
+		for(size_t i = 0; i < current_activation.size(); ++i)
+			current_activation[i]->m_diff = m_output_diffs[i];
+
+		// Same traversal as CG::backprop, the differentials of the parameters land in the network itself
+		for(const auto &node: topological_sort(current_activation))
+		{
+			if(node->m_diff != 0.0)
+				node->backward();
 		}
 
+		for(size_t i = 0; i < inputs.size(); ++i)
+			m_children[i]->m_diff += inputs[i]->diff();
+	}
+
+private:
+	const NeuralNet &m_network;
+	size_t m_first_layer;
+	size_t m_last_layer;
+};
+
+std::pair<std::vector<CG::Value>, std::vector<CG::Value>> NeuralNet::construct_tree(
+	std::optional<uint32_t> seed,
+	std::vector<LayerParameters> *parameters,
+	std::vector<std::vector<CG::Value>> *layer_outputs
+)
+{
+	assert(m_architecture.size() != 0);
+	size_t input_size = m_architecture.begin()->input_size;
+
+	// convert the input into CG::Value(s)
+	std::vector<CG::Value> current_activation = CG::allocate(input_size);
+	auto input_weights = current_activation;
+
+	if(parameters)
+		parameters->clear();
+
+	if(layer_outputs)
+		layer_outputs->clear();
+
+	// for each layer, apply its input
+	for(size_t i = 0; i < m_architecture.size(); ++i)
+	{
+		auto layer_parameters = create_parameters(m_architecture[i], i, seed);
+
 		// switch the 2 lists
-		current_activation = layer_output;
+		current_activation = apply_layer(m_architecture[i], current_activation, layer_parameters);
+
+		if(parameters)
+			parameters->push_back(std::move(layer_parameters));
+
+		if(layer_outputs)
+			layer_outputs->push_back(current_activation);
 	}
 
 	// return [input_weights, output_weights]
 	return std::make_pair(input_weights, current_activation);
 }
 
+void NeuralNet::set_checkpoints(const std::vector<bool> &checkpoints)
+{
+	assert(checkpoints.empty() || checkpoints.size() == m_architecture.size());
+	m_checkpoints = checkpoints;
+
+	// The layer outputs may have been fused away, the graph is rebuilt over the same leaves
+	auto current_activation = m_input_weights;
+	m_layer_outputs.clear();
+	for(size_t i = 0; i < m_architecture.size(); ++i)
+	{
+		current_activation = apply_layer(m_architecture[i], current_activation, m_parameters[i]);
+		m_layer_outputs.push_back(current_activation);
+	}
+
+	m_output_weights = current_activation;
+	compile();
+}
+
+std::vector<CG::Value> NeuralNet::checkpointed_forward()
+{
+	// The input values, then the outputs of each checkpointed layer
+	std::vector<CG::Value> current_activation;
+	current_activation.reserve(m_input_weights.size());
+	for(const auto &v: m_input_weights)
+		current_activation.push_back(CG::value(v->value()));
+
+	size_t first_layer = 0;
+	for(size_t i = 0; i < m_architecture.size(); ++i)
+	{
+		if(!m_checkpoints[i] && i+1 != m_architecture.size())
+			continue;
+
+		auto segment = std::make_shared<LayerSegment>(*this, first_layer, i+1);
+		segment->m_children = current_activation;
+
+		std::vector<double> values;
+		values.reserve(m_layer_outputs[i].size());
+		for(const auto &v: m_layer_outputs[i])
+			values.push_back(v->value());
+
+		current_activation = CG::segment_outputs(segment, values);
+		first_layer = i+1;
+	}
+
+	return current_activation;
+}
+
+void NeuralNet::prune(double sparsity)
+{
+	assert(sparsity >= 0.0 && sparsity <= 1.0);
+
+	std::vector<std::pair<double, uint32_t>> magnitudes;
+	for(size_t l = 0; l < m_architecture.size(); ++l)
+	{
+		if(m_architecture[l].operation != Layer::Func::LINEAR)
+			continue;
+
+		auto &layer_parameters = m_parameters[l];
+		const auto &weights = layer_parameters.weights;
+		auto &mask = layer_parameters.mask;
+		if(mask.empty())
+			mask.assign(weights.size(), 1);
+
+		// The weights already pruned come first whatever their value
+		magnitudes.clear();
+		for(uint32_t i = 0; i < weights.size(); ++i)
+			magnitudes.emplace_back(mask[i] ? std::fabs(weights[i]->value()): -1.0, i);
+
+		const size_t pruned_count = std::lround(sparsity * weights.size());
+		std::nth_element(magnitudes.begin(), magnitudes.begin() + pruned_count, magnitudes.end());
+
+		for(size_t i = 0; i < pruned_count; ++i)
+		{
+			const uint32_t index = magnitudes[i].second;
+			mask[index] = 0;
+			weights[index]->m_value = 0.0;
+			weights[index]->m_vel = 0.0;
+		}
+	}
+}
+
+double NeuralNet::sparsity() const
+{
+	size_t weight_count = 0;
+	size_t pruned_count = 0;
+
+	for(size_t l = 0; l < m_architecture.size(); ++l)
+	{
+		if(m_architecture[l].operation != Layer::Func::LINEAR)
+			continue;
+
+		const auto &mask = m_parameters[l].mask;
+		weight_count += m_parameters[l].weights.size();
+		pruned_count += std::count(mask.begin(), mask.end(), 0);
+	}
+
+	return weight_count > 0 ? (double)pruned_count / weight_count: 0.0;
+}
+
+void NeuralNet::save_architecture(std::ostream &out) const
+{
+	out << m_architecture.size() << std::endl;
+
+	for(auto layer: m_architecture)
+	{
+		out << layer_name(layer.operation) << " " << layer.input_size << " " << layer.output_size;
+
+		if(layer.operation == Layer::Func::CONV2D || layer.operation == Layer::Func::MAXPOOL2D)
+		{
+			out << " " << layer.channels << " " << layer.height << " " << layer.width << " " << layer.out_channels
+				<< " " << layer.kernel << " " << layer.stride << " " << layer.padding;
+		}
+
+		out << std::endl;
+	}
+}
+
+void NeuralNet::compile()
+{
+	// The segments of a checkpointed forward start from the values of the layer outputs, they can't be fused away
+	std::vector<CG::Value> roots = m_output_weights;
+	if(checkpointing())
+	{
+		for(size_t i = 0; i + 1 < m_layer_outputs.size(); ++i)
+			roots.insert(roots.end(), m_layer_outputs[i].begin(), m_layer_outputs[i].end());
+	}
+
+	roots = CG::optimize(roots);
+
+	auto root = roots.begin();
+	m_output_weights.assign(root, root + m_output_weights.size());
+	root += m_output_weights.size();
+
+	if(checkpointing())
+	{
+		for(size_t i = 0; i + 1 < m_layer_outputs.size(); ++i)
+		{
+			m_layer_outputs[i].assign(root, root + m_layer_outputs[i].size());
+			root += m_layer_outputs[i].size();
+		}
+
+		m_layer_outputs.back() = m_output_weights;
+	}
+	else
+	{
+		// They would keep the whole unfused graph alive
+		m_layer_outputs.clear();
+	}
+
+	m_program = CG::Program(m_output_weights);
+}
 
 bool NeuralNet::save_weights(const std::string &path)
 {
@@ -199,18 +623,23 @@ bool NeuralNet::save_weights(const std::string &path)
 		return false;
 	}
 
-	file << m_architecture.size() << std::endl;
+	save_architecture(file);
 
-	for(auto layer: m_architecture)
-	{
-		file << layer_name(layer.operation) << " " << layer.input_size << " " << layer.output_size << std::endl;
-	}
+	// Reversed, the registers of m_program are in the order of topological_sort(m_output_weights).
+	// "%g " is what the stream operator writes with its default precision, several times faster
+	const auto &nodes = m_program.nodes();
+	std::string values;
+	values.reserve(nodes.size() * 8);
 
-	for(const auto &v: topological_sort(m_output_weights))
+	char buffer[32];
+	for(auto it = nodes.rbegin(); it != nodes.rend(); ++it)
 	{
-		file << v->value() << " ";
+		int length = std::snprintf(buffer, sizeof(buffer), "%g ", (*it)->value());
+		values.append(buffer, length);
 	}
 
+	file << values;
+
 	file.close();
 	return true;
 }
@@ -228,26 +657,83 @@ bool NeuralNet::load_weights(const std::string &path)
 	int layer_count = 0;
 	file >> layer_count;
 
-	m_architecture.clear();
+	std::vector<Layer> architecture;
 	std::string layer_name;
 	int input_size = 0;
 	int output_size = 0;
 	NN::Layer layer;
-	for(int i = 0; i < layer_count; ++i)
+	for(int i = 0; i < layer_count && file; ++i)
 	{
 		file >> layer_name >> input_size >> output_size;
-		layer.operation = layer_func(layer_name);
+		auto operation = layer_func(layer_name);
+		if(!operation)
+			break;
+
+		layer.operation = *operation;
 		layer.input_size = input_size;
 		layer.output_size = output_size;
 
-		m_architecture.push_back(layer);
+		if(layer.operation == Layer::Func::CONV2D || layer.operation == Layer::Func::MAXPOOL2D)
+		{
+			file >> layer.channels >> layer.height >> layer.width >> layer.out_channels
+				>> layer.kernel >> layer.stride >> layer.padding;
+		}
+
+		architecture.push_back(layer);
+	}
+
+	// The values are on the line after the header, a checkpoint has more lines after them.
+	// They are parsed from memory, the stream extraction operator is several times slower
+	std::string text;
+	file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+	std::getline(file, text);
+
+	if(!file || layer_count <= 0 || architecture.size() != (size_t)layer_count)
+	{
+		std::cout << "Invalid weights: \"" << path << "\"" << std::endl;
+		return false;
 	}
 
-	auto [m_input_weights, m_output_weights] = construct_tree(false);
+	const char *cursor = text.c_str();
+	std::vector<double> values;
+	for(;;)
+	{
+		char *end = nullptr;
+		double value = std::strtod(cursor, &end);
+		if(end == cursor)
+			break;
+
+		values.push_back(value);
+		cursor = end;
+	}
+
+	m_architecture = architecture;
+	std::tie(m_input_weights, m_output_weights) = construct_tree(std::nullopt, &m_parameters, &m_layer_outputs);
+
+	// Files written before the graph was optimized list every node of the unfused graph, in topological order
+	auto unfused_nodes = topological_sort(m_output_weights);
+	bool unfused = values.size() == unfused_nodes.size();
+	if(unfused)
+	{
+		for(size_t i = 0; i < values.size(); ++i)
+			unfused_nodes[i]->m_value = values[i];
+	}
+
+	unfused_nodes.clear();
+	compile();
+
+	const auto &nodes = m_program.nodes();
+	if(!unfused && values.size() != nodes.size())
+	{
+		std::cout << "Invalid weights: \"" << path << "\", " << values.size() << " values for " << nodes.size() << " nodes" << std::endl;
+		return false;
+	}
 
-	for(const auto &v: topological_sort(m_output_weights))
+	if(!unfused)
 	{
-		file >> v->m_value;
+		auto value = values.begin();
+		for(auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+			(*it)->m_value = *value++;
 	}
 
 	file.close();
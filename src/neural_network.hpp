@@ -1,12 +1,15 @@
 #pragma once
 
 #include "compute_graph.hpp"
+#include "program.hpp"
 
 #include <vector>
 #include <string>
+#include <ostream>
 #include <cstdint>
 #include <initializer_list>
 #include <utility>
+#include <optional>
 
 namespace NN
 {
@@ -17,11 +20,47 @@ namespace NN
  */
 struct Layer
 {
-	enum class Func { SOFTMAX, LINEAR, RELU };
+	enum class Func { SOFTMAX, LINEAR, RELU, CONV2D, MAXPOOL2D };
+
+	// Initialization of the parameters: UNIFORM draws everything in [-1, 1], XAVIER (uniform, for tanh/softmax outputs)
+	// and HE (normal, for relu) scale the weights by the fan in/out and start the biases at 0
+	enum class Init { UNIFORM, XAVIER, HE };
+
+	// Spatial size of the output of CONV2D and MAXPOOL2D layers
+	inline int output_height() const { return (height + 2 * padding - kernel) / stride + 1; }
+	inline int output_width() const { return (width + 2 * padding - kernel) / stride + 1; }
 
 	Func operation;
 	int input_size;
 	int output_size;
+
+	// Only used by LINEAR and CONV2D
+	Init init {Init::UNIFORM};
+
+	// Only used by CONV2D and MAXPOOL2D, activations are laid out as channels x height x width
+	int channels {0};
+	int height {0};
+	int width {0};
+	int out_channels {0};
+	int kernel {0};
+	int stride {1};
+	int padding {0};
+};
+
+/**
+ * @brief Trainable leaves of a layer, empty for layers without parameters
+ * 
+ */
+struct LayerParameters
+{
+	// LINEAR: output_size x input_size, CONV2D: out_channels x channels x kernel x kernel
+	std::vector<CG::Value> weights;
+
+	// One per output (LINEAR) or per output channel (CONV2D)
+	std::vector<CG::Value> biases;
+
+	// Empty unless the layer was pruned (see NeuralNet::prune), then 0 for each weight kept at 0
+	std::vector<uint8_t> mask;
 };
 
 /**
@@ -29,9 +68,36 @@ struct Layer
  * 
  * @param input_size 
  * @param output_size 
+ * @param init 
+ * @return Layer 
+ */
+Layer linear(int input_size, int output_size, Layer::Init init = Layer::Init::UNIFORM);
+
+/**
+ * @brief 2D convolution with out_channels filters of size kernel x kernel, the weights are shared across positions
+ * 
+ * @param channels Number of channels of the input
+ * @param height Height of the input
+ * @param width Width of the input
+ * @param out_channels 
+ * @param kernel 
+ * @param stride 
+ * @param padding Zero padding added on every side of the input
+ * @param init 
+ * @return Layer 
+ */
+Layer conv2d(int channels, int height, int width, int out_channels, int kernel, int stride = 1, int padding = 0, Layer::Init init = Layer::Init::UNIFORM);
+
+/**
+ * @brief Keeps the largest value of each size x size window of each channel (the windows don't overlap)
+ * 
+ * @param channels 
+ * @param height 
+ * @param width 
+ * @param size 
  * @return Layer 
  */
-Layer linear(int input_size, int output_size);
+Layer maxpool2d(int channels, int height, int width, int size);
 
 /**
  * @brief Applies relu to the previous layer
@@ -47,24 +113,93 @@ Layer relu();
  */
 Layer softmax();
 
+// Seed drawn from std::random_device
+uint32_t random_seed();
+
 class NeuralNet
 {
 public:
-	NeuralNet( const std::initializer_list<Layer> &layer_desc );
+	/**
+	 * @brief Builds the network and initializes its parameters. The initialization runs in parallel and only
+	 * depends on the seed, not on the number of threads
+	 * 
+	 * @param layer_desc 
+	 * @param seed 
+	 */
+	NeuralNet( const std::initializer_list<Layer> &layer_desc, uint32_t seed = random_seed() );
+
+	NeuralNet( const std::vector<Layer> &layer_desc, uint32_t seed = random_seed() );
+
+	// Empty network, to be filled by load_weights
+	NeuralNet() = default;
 
 	std::vector<CG::Value> forward(const std::vector<double> &input);
 
 	bool save_weights(const std::string &path);
 	
 	bool load_weights(const std::string &path);
+
+	// Writes the header of the files of save_weights: the number of layers, then one line per layer
+	void save_architecture(std::ostream &out) const;
+
+	/**
+	 * @brief Enables gradient checkpointing: the graph returned by forward only keeps the outputs of the layers i
+	 * where checkpoints[i] is true (and of the last layer), the nodes between them are rebuilt during backprop.
+	 * The differentials then go straight to the network's parameters, and Optimizer::accumulate only counts the sample.
+	 * An empty vector disables it. The network's graph is rebuilt, an Optimizer must be created afterwards
+	 * 
+	 * @param checkpoints One flag per layer
+	 */
+	void set_checkpoints(const std::vector<bool> &checkpoints);
+
+	inline bool checkpointing() const { return !m_checkpoints.empty(); }
+
+	/**
+	 * @brief Magnitude pruning: sets to 0 the weights of smallest magnitude of each LINEAR layer, so that a fraction
+	 * sparsity of them is 0, and masks them so that Optimizer::step keeps them there. The weights already pruned
+	 * stay pruned, the sparsity can only increase
+	 * 
+	 * @param sparsity In [0, 1]
+	 */
+	void prune(double sparsity);
+
+	// Fraction of the weights of the LINEAR layers that are masked
+	double sparsity() const;
+
+	inline const std::vector<Layer> &architecture() const { return m_architecture; }
+
+	// Trainable leaves of each layer, in the same order as architecture()
+	inline const std::vector<LayerParameters> &parameters() const { return m_parameters; }
 	
 	friend class Optimizer;
 private:
-	std::pair<std::vector<CG::Value>, std::vector<CG::Value>> construct_tree(bool random = true);
+	// Without seed, the parameters start at 0
+	std::pair<std::vector<CG::Value>, std::vector<CG::Value>> construct_tree(
+		std::optional<uint32_t> seed = std::nullopt,
+		std::vector<LayerParameters> *parameters = nullptr,
+		std::vector<std::vector<CG::Value>> *layer_outputs = nullptr
+	);
+
+	std::vector<CG::Value> checkpointed_forward();
+
+	/**
+	 * @brief Replaces the graph by the one CG::optimize makes of it and compiles m_program, the weights files and the
+	 * optimizer list the nodes in its order. In checkpointing mode the outputs of every layer are kept
+	 * 
+	 */
+	void compile();
 
 	std::vector<Layer> m_architecture;
+	std::vector<LayerParameters> m_parameters;
+
+	// Output nodes of each layer of the network's own graph, empty unless checkpointing
+	std::vector<std::vector<CG::Value>> m_layer_outputs;
+	std::vector<bool> m_checkpoints;
 	std::vector<CG::Value> m_output_weights;
 	std::vector<CG::Value> m_input_weights;
+
+	// The network's graph compiled, used by forward
+	CG::Program m_program;
 };
 
 } // namespace NN
\ No newline at end of file
@@ -8,17 +8,23 @@ namespace NN
 {
 
 Optimizer::Optimizer(
-		const NeuralNet &net, 
+		NeuralNet &net, 
 		double learning_rate,
 		double momentum
 	)
-	: m_learning_rate(learning_rate),
+	: m_network(net),
+	m_learning_rate(learning_rate),
 	m_momentum(momentum)
 {
 	// Topological is deterministic and for two CG::Value with the same graph,
 	// it will yield the same order. This is how we can pair every weights from
-	// the neural net, with it's loss counterpart
-	m_network_weights = topological_sort(net.m_output_weights);
+	// the neural net, with it's loss counterpart. The network's program already
+	// holds this order, reversed
+	const auto &nodes = net.m_program.nodes();
+	m_network_weights.assign(nodes.rbegin(), nodes.rend());
+
+	m_program = CG::Program(net.m_output_weights);
+	m_memory_plan = m_program.plan_memory(true);
 }
 
 void Optimizer::zero_grad()
@@ -38,6 +44,22 @@ double Optimizer::grad_l2_norm()
 	return sqrt(res);
 }
 
+double PruningSchedule::sparsity(size_t step) const
+{
+	if(step <= begin_step)
+		return initial_sparsity;
+	if(step >= end_step)
+		return final_sparsity;
+
+	const double remaining = 1.0 - (double)(step - begin_step) / (end_step - begin_step);
+	return final_sparsity + (initial_sparsity - final_sparsity) * remaining * remaining * remaining;
+}
+
+bool PruningSchedule::prunes_at(size_t step) const
+{
+	return step >= begin_step && step <= end_step && ((step - begin_step) % frequency == 0 || step == end_step);
+}
+
 void Optimizer::step()
 {
 	for(const auto &v: m_network_weights)
@@ -45,12 +67,31 @@ void Optimizer::step()
 		v->m_vel = m_momentum * v->m_vel + v->m_diff;
 		v->m_value -= m_learning_rate * v->m_vel * (1.0 / (double)m_accumulated_count);
 	}
+
+	for(const auto &layer_parameters: m_network.parameters())
+	{
+		const auto &mask = layer_parameters.mask;
+		for(size_t i = 0; i < mask.size(); ++i)
+		{
+			if(mask[i])
+				continue;
+
+			layer_parameters.weights[i]->m_value = 0.0;
+			layer_parameters.weights[i]->m_vel = 0.0;
+		}
+	}
 }
 
 void Optimizer::accumulate(const CG::Value &cross_enthropy_loss)
 {
 	assert(cross_enthropy_loss->m_op == CG::Op::CROSS_ENTHROPY);
 
+	if(m_network.checkpointing())
+	{
+		++m_accumulated_count;
+		return;
+	}
+
 	// Topological is deterministic and for two CG::Value with the same graph,
 	// it will yield the same order. This is how we can pair every weights from
 	// the neural net, with it's loss counterpart
@@ -66,4 +107,33 @@ void Optimizer::accumulate(const CG::Value &cross_enthropy_loss)
 	++m_accumulated_count;
 }
 
+double Optimizer::accumulate(const std::vector<double> &input, uint32_t label, double weight)
+{
+	assert(input.size() == m_network.m_input_weights.size());
+
+	if(m_network.checkpointing())
+	{
+		// The program would keep every activation, the checkpointed graph adds the differentials to the network itself
+		auto loss = CG::cross_entropy(label, m_network.forward(input));
+		(loss * CG::constant(weight))->backprop();
+
+		++m_accumulated_count;
+		return loss->value();
+	}
+
+	for(size_t i = 0; i < input.size(); ++i)
+		m_network.m_input_weights[i]->m_value = input[i];
+
+	m_program.forward();
+
+	// The cross entropy only depends on the selected output, its derivative starts the reverse pass
+	const uint32_t output = m_program.output(label);
+	const double probability = m_program.value(output);
+	m_program.backprop(output, -weight / (probability + CG::cross_entropy_epsilon));
+	m_program.store_diffs();
+
+	++m_accumulated_count;
+	return -log(probability + CG::cross_entropy_epsilon);
+}
+
 } // namespace NN
\ No newline at end of file
@@ -2,10 +2,36 @@
 
 #include "compute_graph.hpp"
 #include "neural_network.hpp"
+#include "program.hpp"
+
+#include <vector>
+#include <cstdint>
 
 namespace NN
 {
 
+/**
+ * @brief Gradual magnitude pruning: the target sparsity goes from initial_sparsity to final_sparsity between
+ * begin_step and end_step, quickly at first then slower (cubic), so that the network recovers from the last prunings
+ * 
+ */
+struct PruningSchedule
+{
+	double initial_sparsity = 0.0;
+	double final_sparsity = 0.9;
+	size_t begin_step = 0;
+	size_t end_step = 1000;
+
+	// Steps between two prunings
+	size_t frequency = 50;
+
+	// Target sparsity after the given step
+	double sparsity(size_t step) const;
+
+	// Whether NeuralNet::prune(sparsity(step)) should be called after the given step
+	bool prunes_at(size_t step) const;
+};
+
 /**
  * @brief Implements the gradient descent for a given NeuralNet
  * 
@@ -22,7 +48,7 @@ public:
 	 * @param momentum The fraction of the previous gradient that will be added together with the new grad in Optimizer::step
 	 */
 	Optimizer(
-		const NeuralNet &network, 
+		NeuralNet &network, 
 		double learning_rate=0.001,
 		double momentum = 0.9
 	);
@@ -34,19 +60,36 @@ public:
 	void zero_grad();
 
 	/**
-	 * @brief Applies one gradient descent step with the accumulated gradient
+	 * @brief Applies one gradient descent step with the accumulated gradient, the weights masked by
+	 * NeuralNet::prune stay at 0
 	 * 
 	 * @return * void 
 	 */
 	void step();
 
 	/**
-	 * @brief 
+	 * @brief Adds the differentials computed by value->backprop() to the accumulated gradient. When the network
+	 * is in checkpointing mode they are already there, the sample is only counted
 	 * 
 	 * @param value The output of a loss function (ex, CG::cross_entropy)
 	 */
 	void accumulate(const CG::Value &value);
 
+	/**
+	 * @brief Forward and backward pass of one sample with the cross entropy loss, run by a program planned once in
+	 * the constructor: no graph is built and nothing is allocated. When the network is in checkpointing mode, the
+	 * checkpointed graph of NeuralNet::forward is built and backpropagated instead
+	 * 
+	 * @param input 
+	 * @param label Index of the correct class
+	 * @param weight Scales the gradient of the sample, ex: its importance weight given by an ImportanceSampler
+	 * @return double The loss of the sample, not scaled
+	 */
+	double accumulate(const std::vector<double> &input, uint32_t label, double weight = 1.0);
+
+	// Workspace of the program used by accumulate(input, label)
+	inline const CG::MemoryPlan &memory_plan() const { return m_memory_plan; }
+
 	/**
 	 * @brief L2 norm of the accumulated gradient, that is sqrt(sum_i w_i^2) where w_i are the differential's weights
 	 * 
@@ -54,10 +97,17 @@ public:
 	 */
 	double grad_l2_norm();
 
+	friend class CheckpointWriter;
 private:
+	NeuralNet &m_network;
+
 	// The network's output weights
 	std::vector<CG::Value> m_network_weights;
 
+	// The network's graph compiled with a memory plan for training
+	CG::Program m_program;
+	CG::MemoryPlan m_memory_plan;
+
 	// Parameters
 	double m_learning_rate = 0.0;
 	double m_momentum = 0.0;
@@ -0,0 +1,308 @@
+#include "pipeline.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace NN
+{
+
+namespace
+{
+
+// Activations or differentials of one micro-batch, going from one stage to the next
+struct MicroBatch
+{
+	size_t index = 0;
+	std::vector<double> values;
+};
+
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity):
+		m_capacity(capacity)
+	{
+	}
+
+	void push(MicroBatch micro_batch)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_not_full.wait(lock, [this]() { return m_items.size() < m_capacity; });
+		m_items.push_back(std::move(micro_batch));
+		m_not_empty.notify_one();
+	}
+
+	MicroBatch pop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_not_empty.wait(lock, [this]() { return !m_items.empty(); });
+		MicroBatch micro_batch = std::move(m_items.front());
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return micro_batch;
+	}
+
+private:
+	size_t m_capacity;
+	std::deque<MicroBatch> m_items;
+	std::mutex m_mutex;
+	std::condition_variable m_not_full;
+	std::condition_variable m_not_empty;
+};
+
+// Runs the stages concurrently, the calling thread runs the first one
+void run_stages(size_t stage_count, const std::function<void(size_t)> &stage)
+{
+	std::vector<std::thread> threads;
+	for(size_t s = 1; s < stage_count; ++s)
+		threads.emplace_back(stage, s);
+
+	stage(0);
+
+	for(auto &thread: threads)
+		thread.join();
+}
+
+// Multiply-adds of a layer for one sample
+double layer_cost(const DenseNet::DenseLayer &dense_layer)
+{
+	const Layer &layer = dense_layer.layer;
+	switch(layer.operation)
+	{
+	case Layer::Func::LINEAR:
+		return (double)dense_layer.input_size * dense_layer.output_size;
+	case Layer::Func::CONV2D:
+		return (double)dense_layer.output_size * layer.channels * layer.kernel * layer.kernel;
+	default:
+		return (double)dense_layer.output_size;
+	}
+}
+
+} // namespace
+
+PipelinedNet::PipelinedNet(const DenseNet &network, size_t stage_count, size_t micro_batch_size, size_t queue_capacity):
+	m_network(network),
+	m_micro_batch_size(micro_batch_size),
+	m_queue_capacity(queue_capacity)
+{
+	const auto &layers = network.layers();
+	assert(stage_count > 0 && stage_count <= layers.size() && micro_batch_size > 0 && queue_capacity > 0);
+
+	double total_cost = 0.0;
+	for(const auto &dense_layer: layers)
+		total_cost += layer_cost(dense_layer);
+
+	// A stage ends once the cost so far reaches its share, as long as every later stage can have a layer
+	m_stages.push_back(0);
+	double cost = 0.0;
+	for(size_t l = 0; l + 1 < layers.size() && m_stages.size() < stage_count; ++l)
+	{
+		cost += layer_cost(layers[l]);
+
+		bool reached_share = cost >= total_cost * m_stages.size() / stage_count;
+		bool must_cut = layers.size() - (l + 1) == stage_count - m_stages.size();
+		if(reached_share || must_cut)
+			m_stages.push_back(l + 1);
+	}
+}
+
+size_t PipelinedNet::first_layer(size_t stage) const
+{
+	return m_stages[stage];
+}
+
+size_t PipelinedNet::end_layer(size_t stage) const
+{
+	return stage + 1 < m_stages.size() ? m_stages[stage + 1]: m_network.layers().size();
+}
+
+std::vector<double> PipelinedNet::forward(const double *inputs, size_t batch_size) const
+{
+	const auto &layers = m_network.layers();
+	const size_t stage_count = m_stages.size();
+	const size_t micro_batch_count = (batch_size + m_micro_batch_size - 1) / m_micro_batch_size;
+
+	std::vector<double> outputs(batch_size * m_network.output_size());
+
+	// queues[s] goes from stage s to stage s+1
+	std::deque<BoundedQueue> queues;
+	for(size_t s = 0; s + 1 < stage_count; ++s)
+		queues.emplace_back(m_queue_capacity);
+
+	run_stages(stage_count, [&](size_t s) {
+		std::vector<double> next;
+		std::vector<uint32_t> argmax;
+
+		for(size_t m = 0; m < micro_batch_count; ++m)
+		{
+			size_t first = m * m_micro_batch_size;
+			size_t size = std::min(m_micro_batch_size, batch_size - first);
+
+			MicroBatch current;
+			if(s == 0)
+				current.values.assign(inputs + first * m_network.input_size(), inputs + (first + size) * m_network.input_size());
+			else
+				current = queues[s-1].pop();
+
+			for(size_t l = first_layer(s); l < end_layer(s); ++l)
+			{
+				next.resize(size * layers[l].output_size);
+				if(layers[l].layer.operation == Layer::Func::MAXPOOL2D)
+					argmax.resize(next.size());
+
+				m_network.forward_layer(layers[l], current.values.data(), size, next.data(), argmax.data());
+				std::swap(current.values, next);
+			}
+
+			if(s + 1 < stage_count)
+				queues[s].push(std::move(current));
+			else
+				std::copy(current.values.begin(), current.values.end(), outputs.begin() + first * m_network.output_size());
+		}
+	});
+
+	return outputs;
+}
+
+double PipelinedNet::gradient(const double *inputs, const uint32_t *labels, size_t batch_size, double *gradient) const
+{
+	const auto &layers = m_network.layers();
+	const size_t stage_count = m_stages.size();
+	const size_t micro_batch_count = (batch_size + m_micro_batch_size - 1) / m_micro_batch_size;
+	const size_t out_size = m_network.output_size();
+
+	// forward_queues[s] goes from stage s to stage s+1, backward_queues[s] from stage s+1 to stage s
+	std::deque<BoundedQueue> forward_queues;
+	std::deque<BoundedQueue> backward_queues;
+	for(size_t s = 0; s + 1 < stage_count; ++s)
+	{
+		forward_queues.emplace_back(m_queue_capacity);
+		backward_queues.emplace_back(m_queue_capacity);
+	}
+
+	// Only written by the last stage
+	double loss = 0.0;
+
+	run_stages(stage_count, [&](size_t s) {
+		const size_t begin = first_layer(s);
+		const size_t end = end_layer(s);
+
+		// Input and output of each layer of the stage, and the argmax of its MAXPOOL2D layers
+		struct Saved
+		{
+			size_t index = 0;
+			std::vector<std::vector<double>> activations;
+			std::vector<std::vector<uint32_t>> argmax;
+		};
+
+		// The micro-batches go backward in the order they went forward
+		std::deque<Saved> in_flight;
+		size_t forward_count = 0;
+
+		auto micro_batch_size = [&](size_t index) {
+			return std::min(m_micro_batch_size, batch_size - index * m_micro_batch_size);
+		};
+
+		auto forward = [&]() {
+			Saved saved;
+			saved.index = forward_count++;
+			saved.activations.resize(end - begin + 1);
+			saved.argmax.resize(end - begin);
+
+			size_t first = saved.index * m_micro_batch_size;
+			size_t size = micro_batch_size(saved.index);
+
+			if(s == 0)
+				saved.activations[0].assign(inputs + first * m_network.input_size(), inputs + (first + size) * m_network.input_size());
+			else
+				saved.activations[0] = forward_queues[s-1].pop().values;
+
+			for(size_t l = begin; l < end; ++l)
+			{
+				auto &output = saved.activations[l - begin + 1];
+				output.resize(size * layers[l].output_size);
+				if(layers[l].layer.operation == Layer::Func::MAXPOOL2D)
+					saved.argmax[l - begin].resize(output.size());
+
+				m_network.forward_layer(layers[l], saved.activations[l - begin].data(), size, output.data(), saved.argmax[l - begin].data());
+			}
+
+			if(s + 1 < stage_count)
+				forward_queues[s].push({saved.index, saved.activations.back()});
+
+			in_flight.push_back(std::move(saved));
+		};
+
+		auto backward = [&]() {
+			Saved saved = std::move(in_flight.front());
+			in_flight.pop_front();
+
+			size_t first = saved.index * m_micro_batch_size;
+			size_t size = micro_batch_size(saved.index);
+
+			std::vector<double> output_diff;
+			if(s + 1 < stage_count)
+			{
+				output_diff = backward_queues[s].pop().values;
+			}
+			else
+			{
+				// Loss and its differential over the output
+				const auto &output = saved.activations.back();
+				output_diff.assign(output.size(), 0.0);
+
+				for(size_t i = 0; i < size; ++i)
+				{
+					uint32_t label = labels[first + i];
+					assert(label < out_size);
+					const double p = output[i * out_size + label] + CG::cross_entropy_epsilon;
+					loss -= log(p);
+					output_diff[i * out_size + label] = -1.0 / p;
+				}
+			}
+
+			std::vector<double> input_diff;
+			for(size_t l = end; l-- > begin;)
+			{
+				// The differential over the network input is never needed
+				bool needs_input_diff = l > 0;
+				input_diff.resize(needs_input_diff ? size * layers[l].input_size: 0);
+
+				m_network.backward_layer(
+					layers[l], saved.activations[l - begin].data(), saved.activations[l - begin + 1].data(),
+					saved.argmax[l - begin].data(), output_diff.data(), size, gradient,
+					needs_input_diff ? input_diff.data(): nullptr
+				);
+
+				std::swap(output_diff, input_diff);
+			}
+
+			if(s > 0)
+				backward_queues[s-1].push({saved.index, std::move(output_diff)});
+		};
+
+		// 1F1B: warm up with one forward per later stage, then alternate, then finish the backwards
+		size_t warmup = std::min(stage_count - s - 1, micro_batch_count);
+		for(size_t m = 0; m < warmup; ++m)
+			forward();
+
+		for(size_t m = warmup; m < micro_batch_count; ++m)
+		{
+			forward();
+			backward();
+		}
+
+		while(!in_flight.empty())
+			backward();
+	});
+
+	return loss;
+}
+
+} // namespace NN
\ No newline at end of file
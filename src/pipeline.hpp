@@ -0,0 +1,53 @@
+#pragma once
+
+#include "dense_net.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+/**
+ * @brief Pipeline parallel evaluation of a DenseNet: its layers are split into stages of consecutive layers
+ * with about the same cost, each stage running on its own thread so that its parameters stay in the cache of
+ * one core. A batch is cut into micro-batches which flow from stage to stage through bounded queues.
+ * The backward pass follows the 1F1B schedule: once a stage has as many micro-batches in flight as there
+ * are stages after it, it alternates one forward and one backward, which bounds the activations it keeps
+ *
+ */
+class PipelinedNet
+{
+public:
+	/**
+	 * @brief Splits the layers of network into stages, the network can be updated between two calls
+	 *
+	 * @param network Must outlive the pipeline
+	 * @param stage_count At most the number of layers
+	 * @param micro_batch_size
+	 * @param queue_capacity Micro-batches waiting between two stages
+	 */
+	PipelinedNet(const DenseNet &network, size_t stage_count, size_t micro_batch_size = 8, size_t queue_capacity = 2);
+
+	// Index of the first layer of each stage
+	inline const std::vector<size_t> &stages() const { return m_stages; }
+
+	// Same as DenseNet::forward
+	std::vector<double> forward(const double *inputs, size_t batch_size) const;
+
+	// Same as DenseNet::gradient, each stage adds the differentials of its own layers
+	double gradient(const double *inputs, const uint32_t *labels, size_t batch_size, double *gradient) const;
+
+private:
+	// Layers [m_stages[stage], m_stages[stage+1])
+	size_t first_layer(size_t stage) const;
+	size_t end_layer(size_t stage) const;
+
+	const DenseNet &m_network;
+	std::vector<size_t> m_stages;
+	size_t m_micro_batch_size;
+	size_t m_queue_capacity;
+};
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,735 @@
+#include "program.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <utility>
+#include <cmath>
+#include <cassert>
+
+// GCC and clang can take the address of a label: each handler then jumps straight to the next one instead of
+// going back to a switch, which gives every handler its own indirect branch for the predictor to learn
+#if defined(__GNUC__)
+#define PROGRAM_THREADED 1
+#else
+#define PROGRAM_THREADED 0
+#endif
+
+#if PROGRAM_THREADED
+#define HANDLER(name) op_##name
+#define DISPATCH(step) { step ip; goto **(step thread); }
+#else
+#define HANDLER(name) case Opcode::name
+#define DISPATCH(step) { step ip; continue; }
+#endif
+
+namespace CG
+{
+
+// Opcodes whose operands are read from the operand list
+static bool uses_operand_list(Opcode opcode)
+{
+	switch(opcode)
+	{
+	case Opcode::ADD2: case Opcode::SUB: case Opcode::MUL: case Opcode::RELU: case Opcode::HALT:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static Op operation(Opcode opcode)
+{
+	switch(opcode)
+	{
+	case Opcode::ADD2: case Opcode::ADDN: return Op::ADD;
+	case Opcode::SUB: return Op::SUB;
+	case Opcode::MUL: return Op::MUL;
+	case Opcode::RELU: return Op::RELU;
+	case Opcode::SOFTMAX: return Op::SOFTMAX;
+	case Opcode::CROSS_ENTROPY: return Op::CROSS_ENTHROPY;
+	case Opcode::MAX: return Op::MAX;
+	case Opcode::DOT: return Op::DOT;
+	case Opcode::DOT_RELU: return Op::DOT_RELU;
+	default:
+		assert(false);
+		return Op::LEAF;
+	}
+}
+
+static uint32_t argmax(const double *values, const uint32_t *list, uint32_t count)
+{
+	uint32_t best = 0;
+	for(uint32_t i = 1; i < count; ++i)
+	{
+		if(values[list[i]] > values[list[best]])
+			best = i;
+	}
+
+	return best;
+}
+
+// Differential of an instruction's result, which is cleared when its slot is reused
+static inline double take_diff(double *d, uint32_t target, bool clear)
+{
+	const double diff = d[target];
+	if(clear)
+		d[target] = 0.0;
+
+	return diff;
+}
+
+static void dot_backward(const Instruction &instruction, const uint32_t *operands, const double *v, double *d, double diff)
+{
+	const uint32_t *list = operands + instruction.a;
+
+	for(uint32_t i = 0; i < instruction.index; ++i)
+		d[list[i]] += diff;
+
+	for(uint32_t i = instruction.index; i < instruction.b; i += 2)
+	{
+		d[list[i]] += diff * v[list[i+1]];
+		d[list[i+1]] += diff * v[list[i]];
+	}
+}
+
+Program::Program(const std::vector<Value> &outputs)
+{
+	// Reversed, the topological order puts the children before their parents
+	auto sort = topological_sort(outputs);
+	m_nodes.assign(sort.rbegin(), sort.rend());
+
+	// The sort left in each node its position in m_nodes
+	auto reg = [](const Value &node) { return node->m_post_order; };
+
+	m_code.emplace_back();
+
+	size_t softmax_size = 0;
+	Instruction last_softmax;
+	last_softmax.b = 0;
+
+	for(uint32_t r = 0; r < m_nodes.size(); ++r)
+	{
+		const auto &node = m_nodes[r];
+		const auto &children = node->m_children;
+
+		Instruction instruction;
+		instruction.target = r;
+		instruction.index = node->m_input_index;
+
+		switch(node->m_op)
+		{
+		case Op::LEAF:
+			m_leaves.push_back(r);
+			continue;
+		case Op::ADD:
+			instruction.opcode = children.size() == 2 ? Opcode::ADD2: Opcode::ADDN;
+			break;
+		case Op::SUB:
+			instruction.opcode = Opcode::SUB;
+			break;
+		case Op::MUL:
+			instruction.opcode = Opcode::MUL;
+			break;
+		case Op::RELU:
+			instruction.opcode = Opcode::RELU;
+			break;
+		case Op::SOFTMAX:
+			instruction.opcode = Opcode::SOFTMAX;
+			break;
+		case Op::CROSS_ENTHROPY:
+			instruction.opcode = Opcode::CROSS_ENTROPY;
+			break;
+		case Op::MAX:
+			instruction.opcode = Opcode::MAX;
+			break;
+		case Op::DOT:
+			instruction.opcode = Opcode::DOT;
+			break;
+		case Op::DOT_RELU:
+			instruction.opcode = Opcode::DOT_RELU;
+			break;
+		default:
+			// Segments run their own code during the backward pass
+			assert(false);
+			break;
+		}
+
+		if(uses_operand_list(instruction.opcode))
+		{
+			instruction.a = m_operands.size();
+			instruction.b = children.size();
+			for(const auto &child: children)
+				m_operands.push_back(reg(child));
+
+			// The outputs of a softmax share their operands: sharing the list too lets both passes
+			// compute the exponentials once for all of them
+			if(instruction.opcode == Opcode::SOFTMAX)
+			{
+				if(last_softmax.b == instruction.b && std::equal(
+					m_operands.begin() + last_softmax.a, m_operands.begin() + last_softmax.a + last_softmax.b,
+					m_operands.begin() + instruction.a))
+				{
+					m_operands.resize(instruction.a);
+					instruction.a = last_softmax.a;
+				}
+
+				last_softmax = instruction;
+				softmax_size = std::max<size_t>(softmax_size, instruction.b);
+			}
+		}
+		else
+		{
+			instruction.a = reg(children[0]);
+			if(children.size() > 1)
+				instruction.b = reg(children[1]);
+		}
+
+		m_code.push_back(instruction);
+	}
+
+	m_code.emplace_back();
+
+	for(const auto &output: outputs)
+		m_outputs.push_back(reg(output));
+
+	m_values.reserve(m_nodes.size());
+	for(const auto &node: m_nodes)
+		m_values.push_back(node->m_value);
+
+	m_diffs.assign(m_nodes.size(), 0.0);
+	m_softmax.assign(softmax_size, 0.0);
+
+	m_slots.resize(m_nodes.size());
+	for(uint32_t r = 0; r < m_nodes.size(); ++r)
+		m_slots[r] = r;
+
+#if PROGRAM_THREADED
+	const void *const *handlers = nullptr;
+
+	run_forward(&handlers);
+	for(const auto &instruction: m_code)
+		m_forward_thread.push_back(handlers[static_cast<size_t>(instruction.opcode)]);
+
+	run_backward(&handlers);
+	for(const auto &instruction: m_code)
+		m_backward_thread.push_back(handlers[static_cast<size_t>(instruction.opcode)]);
+#endif
+}
+
+void Program::forward()
+{
+	for(auto r: m_leaves)
+		m_values[m_slots[r]] = m_nodes[r]->m_value;
+
+	run_forward();
+}
+
+size_t Program::backprop(uint32_t reg, double diff)
+{
+	assert(!m_planned || m_training_plan);
+
+	std::fill(m_diffs.begin(), m_diffs.end(), 0.0);
+	m_diffs[m_slots[reg]] = diff;
+
+	return run_backward();
+}
+
+MemoryPlan Program::plan_memory(bool training)
+{
+	assert(!m_planned);
+
+	MemoryPlan plan;
+	plan.register_count = m_nodes.size();
+
+	// Calls f on every register an instruction reads
+	auto for_each_operand = [this](const Instruction &instruction, auto f) {
+		if(uses_operand_list(instruction.opcode))
+		{
+			for(uint32_t i = 0; i < instruction.b; ++i)
+				f(m_operands[instruction.a + i]);
+		}
+		else
+		{
+			f(instruction.a);
+			if(instruction.opcode != Opcode::RELU)
+				f(instruction.b);
+		}
+	};
+
+	// Position of the instruction computing each register, and of the last one reading it in the forward pass
+	std::vector<uint32_t> definition(m_nodes.size(), 0);
+	std::vector<uint32_t> last_use(m_nodes.size(), 0);
+	std::vector<bool> pinned(m_nodes.size(), false);
+
+	// Leaves are loaded before the pass and their differentials read after it, outputs are read after it
+	for(auto r: m_leaves)
+		pinned[r] = true;
+	for(auto r: m_outputs)
+		pinned[r] = true;
+
+	for(uint32_t k = 1; k+1 < m_code.size(); ++k)
+	{
+		const auto &instruction = m_code[k];
+		const uint32_t *list = m_operands.data() + instruction.a;
+
+		for_each_operand(instruction, [&](uint32_t r) { last_use[r] = k; });
+		definition[instruction.target] = k;
+		last_use[instruction.target] = k;
+
+		if(!training)
+			continue;
+
+		// The values the reverse pass reads, see run_backward
+		switch(instruction.opcode)
+		{
+		case Opcode::MUL:
+			pinned[instruction.a] = pinned[instruction.b] = true;
+			break;
+		case Opcode::RELU:
+			pinned[instruction.target] = true;
+			break;
+		case Opcode::SOFTMAX:
+			pinned[instruction.target] = true;
+			[[fallthrough]];
+		case Opcode::MAX:
+			for(uint32_t i = 0; i < instruction.b; ++i)
+				pinned[list[i]] = true;
+			break;
+		case Opcode::CROSS_ENTROPY:
+			pinned[list[instruction.index]] = true;
+			break;
+		case Opcode::DOT:
+		case Opcode::DOT_RELU:
+			pinned[instruction.target] = true;
+			for(uint32_t i = instruction.index; i < instruction.b; ++i)
+				pinned[list[i]] = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// Linear scan in the order of the instructions: a slot is released once the instruction after its register's
+	// last use is reached. Two registers sharing a slot have disjoint forward lifetimes, so their differentials,
+	// written by the instructions reading them and read by their own instruction, have disjoint lifetimes too
+	using Lifetime = std::pair<uint32_t, uint32_t>;
+	std::priority_queue<Lifetime, std::vector<Lifetime>, std::greater<Lifetime>> busy;
+	std::vector<uint32_t> free_slots;
+	std::vector<uint32_t> slots(m_nodes.size());
+	uint32_t slot_count = 0;
+
+	for(uint32_t r = 0; r < m_nodes.size(); ++r)
+	{
+		if(pinned[r])
+		{
+			slots[r] = slot_count++;
+			++plan.pinned_count;
+			continue;
+		}
+
+		while(!busy.empty() && busy.top().first < definition[r])
+		{
+			free_slots.push_back(busy.top().second);
+			busy.pop();
+		}
+
+		if(free_slots.empty())
+		{
+			slots[r] = slot_count++;
+		}
+		else
+		{
+			slots[r] = free_slots.back();
+			free_slots.pop_back();
+		}
+
+		busy.emplace(last_use[r], slots[r]);
+	}
+
+	// From now on, the instructions address slots instead of registers
+	for(size_t k = 1; k+1 < m_code.size(); ++k)
+	{
+		auto &instruction = m_code[k];
+		instruction.target = slots[instruction.target];
+
+		if(!uses_operand_list(instruction.opcode))
+		{
+			instruction.a = slots[instruction.a];
+			if(instruction.opcode != Opcode::RELU)
+				instruction.b = slots[instruction.b];
+		}
+	}
+
+	for(auto &operand: m_operands)
+		operand = slots[operand];
+
+	m_slots = std::move(slots);
+	m_values.assign(slot_count, 0.0);
+	m_diffs.assign(slot_count, 0.0);
+	m_planned = true;
+	m_training_plan = training;
+
+	plan.slot_count = slot_count;
+	return plan;
+}
+
+void Program::store_values() const
+{
+	assert(!m_planned);
+
+	for(size_t r = 0; r < m_nodes.size(); ++r)
+		m_nodes[r]->m_value = m_values[r];
+}
+
+void Program::store_diffs() const
+{
+	for(auto r: m_leaves)
+		m_nodes[r]->m_diff += m_diffs[m_slots[r]];
+}
+
+std::vector<Value> Program::clone() const
+{
+	assert(!m_planned);
+
+	std::vector<Value> copies(m_nodes.size());
+
+	for(auto r: m_leaves)
+	{
+		copies[r] = std::make_shared<CG>(m_values[r]);
+		copies[r]->m_constant = m_nodes[r]->m_constant;
+	}
+
+	for(size_t i = 1; i+1 < m_code.size(); ++i)
+	{
+		const auto &instruction = m_code[i];
+		auto node = std::make_shared<CG>(m_values[instruction.target]);
+
+		node->m_op = operation(instruction.opcode);
+		node->m_input_index = instruction.index;
+
+		if(uses_operand_list(instruction.opcode))
+		{
+			node->m_children.reserve(instruction.b);
+			for(uint32_t j = 0; j < instruction.b; ++j)
+				node->m_children.push_back(copies[m_operands[instruction.a + j]]);
+		}
+		else
+		{
+			node->m_children.push_back(copies[instruction.a]);
+			if(instruction.opcode != Opcode::RELU)
+				node->m_children.push_back(copies[instruction.b]);
+		}
+
+		copies[instruction.target] = std::move(node);
+	}
+
+	std::vector<Value> outputs;
+	outputs.reserve(m_outputs.size());
+	for(auto r: m_outputs)
+		outputs.push_back(copies[r]);
+
+	return outputs;
+}
+
+// Labels as values are an extension, which -Wpedantic reports
+#if PROGRAM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+void Program::run_forward(const void *const **handlers)
+{
+#if PROGRAM_THREADED
+	// Same order as Opcode
+	static const void *const labels[] = {
+		&&op_ADD2, &&op_ADDN, &&op_SUB, &&op_MUL, &&op_RELU, &&op_SOFTMAX,
+		&&op_CROSS_ENTROPY, &&op_MAX, &&op_DOT, &&op_DOT_RELU, &&op_HALT
+	};
+
+	if(handlers)
+	{
+		*handlers = labels;
+		return;
+	}
+#else
+	assert(!handlers);
+#endif
+
+	double *v = m_values.data();
+	const uint32_t *operands = m_operands.data();
+	const Instruction *ip = m_code.data() + 1;
+
+	// Largest operand and sum of the exponentials of the operand list used by the last SOFTMAX instruction
+	uint32_t softmax_list = UINT32_MAX;
+	double softmax_max = 0.0;
+	double softmax_total = 0.0;
+
+#if PROGRAM_THREADED
+	const void *const *thread = m_forward_thread.data() + 1;
+	goto **thread;
+#else
+	for(;;)
+	switch(ip->opcode)
+	{
+#endif
+	HANDLER(ADD2):
+	{
+		v[ip->target] = v[ip->a] + v[ip->b];
+		DISPATCH(++);
+	}
+	HANDLER(ADDN):
+	{
+		const uint32_t *list = operands + ip->a;
+		double sum = 0.0;
+		for(uint32_t i = 0; i < ip->b; ++i)
+			sum += v[list[i]];
+
+		v[ip->target] = sum;
+		DISPATCH(++);
+	}
+	HANDLER(SUB):
+	{
+		v[ip->target] = v[ip->a] - v[ip->b];
+		DISPATCH(++);
+	}
+	HANDLER(MUL):
+	{
+		v[ip->target] = v[ip->a] * v[ip->b];
+		DISPATCH(++);
+	}
+	HANDLER(RELU):
+	{
+		v[ip->target] = v[ip->a] > 0.0 ? v[ip->a]: 0.0;
+		DISPATCH(++);
+	}
+	HANDLER(SOFTMAX):
+	{
+		const uint32_t *list = operands + ip->a;
+		if(ip->a != softmax_list)
+		{
+			softmax_list = ip->a;
+			softmax_max = v[list[argmax(v, list, ip->b)]];
+			softmax_total = 0.0;
+			for(uint32_t i = 0; i < ip->b; ++i)
+				softmax_total += exp(v[list[i]] - softmax_max);
+		}
+
+		v[ip->target] = exp(v[list[ip->index]] - softmax_max) / softmax_total;
+		DISPATCH(++);
+	}
+	HANDLER(CROSS_ENTROPY):
+	{
+		v[ip->target] = -log(v[operands[ip->a + ip->index]] + cross_entropy_epsilon);
+		DISPATCH(++);
+	}
+	HANDLER(MAX):
+	{
+		const uint32_t *list = operands + ip->a;
+		v[ip->target] = v[list[argmax(v, list, ip->b)]];
+		DISPATCH(++);
+	}
+	HANDLER(DOT):
+	HANDLER(DOT_RELU):
+	{
+		const uint32_t *list = operands + ip->a;
+		double sum = 0.0;
+		for(uint32_t i = 0; i < ip->index; ++i)
+			sum += v[list[i]];
+		for(uint32_t i = ip->index; i < ip->b; i += 2)
+			sum += v[list[i]] * v[list[i+1]];
+
+		if(ip->opcode == Opcode::DOT_RELU && sum < 0.0)
+			sum = 0.0;
+
+		v[ip->target] = sum;
+		DISPATCH(++);
+	}
+	HANDLER(HALT):
+		return;
+#if !PROGRAM_THREADED
+	}
+#endif
+}
+
+size_t Program::run_backward(const void *const **handlers)
+{
+#if PROGRAM_THREADED
+	// Same order as Opcode
+	static const void *const labels[] = {
+		&&op_ADD2, &&op_ADDN, &&op_SUB, &&op_MUL, &&op_RELU, &&op_SOFTMAX,
+		&&op_CROSS_ENTROPY, &&op_MAX, &&op_DOT, &&op_DOT_RELU, &&op_HALT
+	};
+
+	if(handlers)
+	{
+		*handlers = labels;
+		return 0;
+	}
+#else
+	assert(!handlers);
+#endif
+
+	const double *v = m_values.data();
+	double *d = m_diffs.data();
+	const uint32_t *operands = m_operands.data();
+	const Instruction *ip = m_code.data() + m_code.size() - 2;
+
+	// With a memory plan, the slot of a differential is reused by registers whose differential is computed
+	// later in the pass, they expect to find it at 0
+	const bool clear_diffs = m_planned;
+
+	// The softmax of the operand list used by the last SOFTMAX instruction is kept in m_softmax
+	uint32_t softmax_list = UINT32_MAX;
+	double *softmax = m_softmax.data();
+
+	size_t active_count = 0;
+
+#if PROGRAM_THREADED
+	const void *const *thread = m_backward_thread.data() + m_code.size() - 2;
+	goto **thread;
+#else
+	for(;;)
+	switch(ip->opcode)
+	{
+#endif
+	HANDLER(ADD2):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		d[ip->a] += diff;
+		d[ip->b] += diff;
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(ADDN):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		const uint32_t *list = operands + ip->a;
+		for(uint32_t i = 0; i < ip->b; ++i)
+			d[list[i]] += diff;
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(SUB):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		d[ip->a] += diff;
+		d[ip->b] -= diff;
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(MUL):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		d[ip->a] += diff * v[ip->b];
+		d[ip->b] += diff * v[ip->a];
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(RELU):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		if(v[ip->target] > 0.0)
+			d[ip->a] += diff;
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(SOFTMAX):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		const uint32_t *list = operands + ip->a;
+		if(ip->a != softmax_list)
+		{
+			softmax_list = ip->a;
+			const double max_value = v[list[argmax(v, list, ip->b)]];
+			double total = 0.0;
+			for(uint32_t i = 0; i < ip->b; ++i)
+			{
+				softmax[i] = exp(v[list[i]] - max_value);
+				total += softmax[i];
+			}
+			for(uint32_t i = 0; i < ip->b; ++i)
+				softmax[i] /= total;
+		}
+
+		// d y_k / d x_i = y_k * ([i == k] - y_i)
+		const double y = v[ip->target];
+		for(uint32_t i = 0; i < ip->b; ++i)
+			d[list[i]] -= diff * y * softmax[i];
+		d[list[ip->index]] += diff * y;
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(CROSS_ENTROPY):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		const uint32_t selected = operands[ip->a + ip->index];
+		d[selected] -= diff / (v[selected] + cross_entropy_epsilon);
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(MAX):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		const uint32_t *list = operands + ip->a;
+		d[list[argmax(v, list, ip->b)]] += diff;
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(DOT):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0)
+			DISPATCH(--);
+
+		dot_backward(*ip, operands, v, d, diff);
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(DOT_RELU):
+	{
+		const double diff = take_diff(d, ip->target, clear_diffs);
+		if(diff == 0.0 || v[ip->target] <= 0.0)
+			DISPATCH(--);
+
+		dot_backward(*ip, operands, v, d, diff);
+		++active_count;
+		DISPATCH(--);
+	}
+	HANDLER(HALT):
+		return active_count;
+#if !PROGRAM_THREADED
+	}
+#endif
+}
+
+#if PROGRAM_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+} // namespace CG
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "compute_graph.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace CG
+{
+
+/**
+ * @brief Operations of a Program, specialized by arity where it avoids a loop
+ *
+ */
+enum class Opcode : uint8_t
+{
+	ADD2, ADDN, SUB, MUL, RELU, SOFTMAX, CROSS_ENTROPY, MAX, DOT, DOT_RELU, HALT
+};
+
+struct Instruction
+{
+	Opcode opcode {Opcode::HALT};
+
+	// Register holding the result
+	uint32_t target {0};
+
+	// ADD2, SUB, MUL: the two operand registers, RELU: the operand register in a
+	// Other opcodes: the operand registers are the b elements of the operand list starting at a
+	uint32_t a {0};
+	uint32_t b {0};
+
+	// SOFTMAX, CROSS_ENTROPY: position of the selected operand, DOT and DOT_RELU: number of plain addends
+	uint32_t index {0};
+};
+
+/**
+ * @brief Workspace of a Program before and after Program::plan_memory
+ *
+ */
+struct MemoryPlan
+{
+	size_t register_count {0};
+	size_t slot_count {0};
+
+	// Slots owned by a single register for the whole pass: leaves, outputs and, when planning for training,
+	// the values read by the reverse pass
+	size_t pinned_count {0};
+
+	// A value and a differential per slot
+	inline size_t bytes() const { return 2 * slot_count * sizeof(double); }
+	inline size_t unplanned_bytes() const { return 2 * register_count * sizeof(double); }
+};
+
+/**
+ * @brief A graph lowered to bytecode: every node gets a register, every operation an instruction reading and
+ * writing registers. The instructions are run forward and in reverse by a threaded interpreter, which avoids the
+ * pointer chasing and the sort of CG::forward and CG::backprop. Graphs holding segments can't be compiled
+ *
+ */
+class Program
+{
+public:
+	Program() = default;
+
+	/**
+	 * @brief Compiles every node reachable from the outputs. Leaves are read from the graph at each forward pass,
+	 * so changing their value doesn't require a new compilation, changing the graph does
+	 *
+	 * @param outputs
+	 */
+	Program(const std::vector<Value> &outputs);
+
+	inline bool empty() const { return m_nodes.empty(); }
+
+	// Register of the i-th output given to the constructor
+	inline uint32_t output(size_t i) const { return m_outputs[i]; }
+
+	inline double value(uint32_t reg) const { return m_values[m_slots[reg]]; }
+
+	inline double diff(uint32_t reg) const { return m_diffs[m_slots[reg]]; }
+
+	inline bool planned() const { return m_planned; }
+
+	// Node compiled into each register, children always come before their parents
+	inline const std::vector<Value> &nodes() const { return m_nodes; }
+
+	// Loads the value of the leaves and runs every instruction
+	void forward();
+
+	/**
+	 * @brief Computes the differential of a register over every other one. Like CG::backprop, instructions
+	 * whose result received a zero differential are skipped
+	 *
+	 * @param reg
+	 * @param diff Differential given to reg, the others are scaled by it (ex: the derivative of a loss over reg)
+	 * @return size_t How many instructions were run
+	 */
+	size_t backprop(uint32_t reg, double diff = 1.0);
+
+	/**
+	 * @brief Static memory planning: computes the lifetime of every register and gives the registers whose
+	 * lifetimes don't overlap the same slot of a smaller workspace, allocated once. The differentials live in
+	 * the reverse pass, mirroring the values in the forward pass, so they share the same slots.
+	 * Afterwards value() and diff() only make sense for the leaves and the outputs, and store_values and clone
+	 * can't be called anymore
+	 *
+	 * @param training Whether backprop will be called, the values it reads then keep their slot
+	 * @return MemoryPlan
+	 */
+	MemoryPlan plan_memory(bool training);
+
+	// Writes the registers to the m_value of their nodes
+	void store_values() const;
+
+	// Adds the differential of the leaves' registers to their m_diff
+	void store_diffs() const;
+
+	/**
+	 * @brief Builds a new graph with the same structure as the compiled one, holding the values of the registers
+	 *
+	 * @return std::vector<Value> The copies of the outputs
+	 */
+	std::vector<Value> clone() const;
+
+private:
+	// Runs the instructions forward or in reverse, or only gives the address of the handlers when handlers isn't null
+	void run_forward(const void *const **handlers = nullptr);
+	size_t run_backward(const void *const **handlers = nullptr);
+
+	std::vector<Value> m_nodes;
+	std::vector<uint32_t> m_leaves;
+	std::vector<uint32_t> m_outputs;
+
+	// Slot of m_values and m_diffs holding each register, the identity until plan_memory is called
+	std::vector<uint32_t> m_slots;
+	bool m_planned {false};
+	bool m_training_plan {false};
+
+	// Surrounded by HALT instructions, so that both passes stop without checking bounds
+	std::vector<Instruction> m_code;
+	std::vector<uint32_t> m_operands;
+
+	// Address of the handler of each instruction, for each direction, when the compiler supports computed gotos
+	std::vector<const void*> m_forward_thread;
+	std::vector<const void*> m_backward_thread;
+
+	std::vector<double> m_values;
+	std::vector<double> m_diffs;
+
+	// Softmax of the operand list used by the last SOFTMAX instruction of the reverse pass
+	std::vector<double> m_softmax;
+};
+
+} // namespace CG
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "quantized_net.hpp"
+#include "kernels.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+namespace NN
+{
+
+// Symmetric quantization, -128 is left unused so that the range is the same on both sides
+constexpr double int8_range = 127.0;
+
+static double symmetric_scale(const double *values, size_t count)
+{
+	double max_abs = 0.0;
+	for(size_t i = 0; i < count; ++i)
+		max_abs = std::max(max_abs, std::fabs(values[i]));
+
+	return max_abs > 0.0 ? max_abs / int8_range: 1.0;
+}
+
+static void quantize(const double *values, size_t count, double scale, int8_t *out)
+{
+	const double inverse_scale = 1.0 / scale;
+	for(size_t i = 0; i < count; ++i)
+	{
+		double q = std::round(values[i] * inverse_scale);
+		out[i] = static_cast<int8_t>(std::min(std::max(q, -int8_range), int8_range));
+	}
+}
+
+int32_t dot_int8(const int8_t *a, const int8_t *b, size_t size)
+{
+	// Widening multiply-add on a plain loop: the compiler turns it into packed int8 -> int16/int32 madds
+	int32_t sum = 0;
+	for(size_t i = 0; i < size; ++i)
+		sum += int32_t(a[i]) * int32_t(b[i]);
+
+	return sum;
+}
+
+// Same as im2col, but transposed (one row per output position) so that each output is a contiguous dot product
+static void im2row_int8(const Layer &layer, const int8_t *input, int8_t *rows)
+{
+	for(int oy = 0; oy < layer.output_height(); ++oy)
+	for(int ox = 0; ox < layer.output_width(); ++ox)
+	{
+		for(int c = 0; c < layer.channels; ++c)
+		for(int ky = 0; ky < layer.kernel; ++ky)
+		for(int kx = 0; kx < layer.kernel; ++kx)
+		{
+			const int iy = oy * layer.stride - layer.padding + ky;
+			const int ix = ox * layer.stride - layer.padding + kx;
+			const bool inside = iy >= 0 && iy < layer.height && ix >= 0 && ix < layer.width;
+			*rows++ = inside ? input[(c * layer.height + iy) * layer.width + ix]: 0;
+		}
+	}
+}
+
+QuantizedNet::QuantizedNet(const DenseNet &network, const double *calibration_inputs, size_t calibration_size)
+{
+	assert(calibration_size > 0);
+	auto activations = network.forward_layers(calibration_inputs, calibration_size);
+
+	for(size_t l = 0; l < network.layers().size(); ++l)
+	{
+		const auto &dense_layer = network.layers()[l];
+
+		QuantizedLayer quantized;
+		quantized.layer = dense_layer.layer;
+		quantized.input_size = dense_layer.input_size;
+		quantized.output_size = dense_layer.output_size;
+
+		if(dense_layer.layer.operation == Layer::Func::LINEAR || dense_layer.layer.operation == Layer::Func::CONV2D)
+		{
+			const double *weights = network.parameters().data() + dense_layer.weights_offset;
+			const double *biases = network.parameters().data() + dense_layer.biases_offset;
+			const size_t weight_count = dense_layer.biases_offset - dense_layer.weights_offset;
+			const size_t bias_count = dense_layer.layer.operation == Layer::Func::LINEAR ?
+				dense_layer.output_size: dense_layer.layer.out_channels;
+
+			quantized.weight_scale = symmetric_scale(weights, weight_count);
+			quantized.input_scale = symmetric_scale(activations[l].data(), activations[l].size());
+
+			quantized.weights.resize(weight_count);
+			quantize(weights, weight_count, quantized.weight_scale, quantized.weights.data());
+
+			const double accumulator_scale = quantized.weight_scale * quantized.input_scale;
+			for(size_t i = 0; i < bias_count; ++i)
+				quantized.biases.push_back(static_cast<int32_t>(std::lround(biases[i] / accumulator_scale)));
+		}
+
+		m_layers.push_back(std::move(quantized));
+	}
+}
+
+std::vector<double> QuantizedNet::forward(const double *inputs, size_t batch_size) const
+{
+	std::vector<double> current(inputs, inputs + batch_size * m_layers.front().input_size);
+	std::vector<double> next;
+	std::vector<int8_t> quantized_input;
+	std::vector<int8_t> rows;
+	std::vector<uint32_t> argmax;
+
+	for(const auto &layer: m_layers)
+	{
+		const size_t in_size = layer.input_size;
+		const size_t out_size = layer.output_size;
+		const double accumulator_scale = layer.weight_scale * layer.input_scale;
+		next.resize(batch_size * out_size);
+
+		switch(layer.layer.operation)
+		{
+		case Layer::Func::LINEAR:
+			quantized_input.resize(current.size());
+			quantize(current.data(), current.size(), layer.input_scale, quantized_input.data());
+
+			for(size_t s = 0; s < batch_size; ++s)
+			{
+				const int8_t *x = quantized_input.data() + s * in_size;
+				for(size_t o = 0; o < out_size; ++o)
+				{
+					int32_t accumulator = layer.biases[o] + dot_int8(layer.weights.data() + o * in_size, x, in_size);
+					next[s * out_size + o] = accumulator * accumulator_scale;
+				}
+			}
+			break;
+		case Layer::Func::CONV2D:
+		{
+			const size_t patch_size = layer.layer.channels * layer.layer.kernel * layer.layer.kernel;
+			const size_t positions = layer.layer.output_height() * layer.layer.output_width();
+
+			quantized_input.resize(current.size());
+			quantize(current.data(), current.size(), layer.input_scale, quantized_input.data());
+			rows.resize(positions * patch_size);
+
+			for(size_t s = 0; s < batch_size; ++s)
+			{
+				im2row_int8(layer.layer, quantized_input.data() + s * in_size, rows.data());
+				double *out = next.data() + s * out_size;
+
+				for(int oc = 0; oc < layer.layer.out_channels; ++oc)
+				{
+					const int8_t *filter = layer.weights.data() + oc * patch_size;
+					for(size_t p = 0; p < positions; ++p)
+					{
+						int32_t accumulator = layer.biases[oc] + dot_int8(filter, rows.data() + p * patch_size, patch_size);
+						out[oc * positions + p] = accumulator * accumulator_scale;
+					}
+				}
+			}
+			break;
+		}
+		case Layer::Func::MAXPOOL2D:
+			argmax.resize(out_size);
+			for(size_t s = 0; s < batch_size; ++s)
+				maxpool2d_forward(layer.layer, current.data() + s * in_size, next.data() + s * out_size, argmax.data());
+			break;
+		case Layer::Func::RELU:
+			for(size_t i = 0; i < next.size(); ++i)
+				next[i] = current[i] > 0.0 ? current[i]: 0.0;
+			break;
+		case Layer::Func::SOFTMAX:
+			for(size_t s = 0; s < batch_size; ++s)
+				softmax_forward(current.data() + s * in_size, in_size, next.data() + s * out_size);
+			break;
+		default:
+			assert(false);
+			break;
+		}
+
+		std::swap(current, next);
+	}
+
+	return current;
+}
+
+size_t QuantizedNet::parameter_bytes() const
+{
+	size_t bytes = 0;
+	for(const auto &layer: m_layers)
+		bytes += layer.weights.size() * sizeof(int8_t) + layer.biases.size() * sizeof(int32_t);
+
+	return bytes;
+}
+
+} // namespace NN
\ No newline at end of file
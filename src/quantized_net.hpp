@@ -0,0 +1,71 @@
+#pragma once
+
+#include "dense_net.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+/**
+ * @brief Dot product of two int8 vectors, accumulated in int32
+ * 
+ * @param a 
+ * @param b 
+ * @param size 
+ * @return int32_t 
+ */
+int32_t dot_int8(const int8_t *a, const int8_t *b, size_t size);
+
+/**
+ * @brief Post-training int8 quantization of a DenseNet, for inference only.
+ * The weights of the LINEAR and CONV2D layers are stored as int8 with one scale per layer, and their input
+ * is quantized with a scale calibrated on sample data. The products are accumulated in int32 (the biases are stored
+ * as int32 in the accumulator's scale) and converted back to floating point for the other layers
+ * 
+ */
+class QuantizedNet
+{
+public:
+	/**
+	 * @brief Quantizes network, the activation scales come from the largest values seen on the calibration samples
+	 * 
+	 * @param network 
+	 * @param calibration_inputs calibration_size x network.input_size(), row-major
+	 * @param calibration_size 
+	 */
+	QuantizedNet(const DenseNet &network, const double *calibration_inputs, size_t calibration_size);
+
+	/**
+	 * @brief Output of the network for a batch of inputs
+	 * 
+	 * @param inputs batch_size x input_size, row-major
+	 * @param batch_size 
+	 * @return std::vector<double> batch_size x output_size, row-major
+	 */
+	std::vector<double> forward(const double *inputs, size_t batch_size) const;
+
+	// Memory used by the parameters, in bytes
+	size_t parameter_bytes() const;
+
+private:
+	struct QuantizedLayer
+	{
+		Layer layer;
+		size_t input_size;
+		size_t output_size;
+
+		std::vector<int8_t> weights;
+		std::vector<int32_t> biases;
+
+		// real value = scale * quantized value
+		double weight_scale = 1.0;
+		double input_scale = 1.0;
+	};
+
+	std::vector<QuantizedLayer> m_layers;
+};
+
+} // namespace NN
\ No newline at end of file
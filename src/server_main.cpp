@@ -0,0 +1,73 @@
+#include "neural_network.hpp"
+#include "inference_server.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+
+static volatile std::sig_atomic_t interrupted = 0;
+
+static void on_signal(int)
+{
+	interrupted = 1;
+}
+
+static void print_stats(const NN::ServerStats &stats)
+{
+	std::cout << "Requests: " << stats.requests << " in " << stats.batches << " batches"
+		<< ", " << stats.throughput << " requests/s"
+		<< ", p50: " << stats.p50_latency_ms << "ms"
+		<< ", p99: " << stats.p99_latency_ms << "ms" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2)
+	{
+		std::cout << "Usage: autograd_nn_server <weights> [socket path] [max batch size] [latency budget in us]" << std::endl;
+		return 1;
+	}
+
+	NN::NeuralNet neural_net;
+	if(!neural_net.load_weights(argv[1]))
+		return 1;
+
+	NN::ServerSettings settings;
+	if(argc > 2)
+		settings.socket_path = argv[2];
+	if(argc > 3)
+		settings.max_batch_size = std::stoul(argv[3]);
+	if(argc > 4)
+		settings.latency_budget = std::chrono::microseconds(std::stol(argv[4]));
+
+	if(settings.max_batch_size == 0)
+	{
+		std::cout << "The largest batch size must be positive" << std::endl;
+		return 1;
+	}
+
+	std::signal(SIGINT, on_signal);
+	std::signal(SIGTERM, on_signal);
+
+	NN::InferenceServer server(neural_net, settings);
+	std::thread server_thread(&NN::InferenceServer::run, &server);
+
+	std::cout << "Listening on " << settings.socket_path << std::endl;
+
+	int seconds = 0;
+	while(!interrupted)
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+
+		if(++seconds % 10 == 0)
+			print_stats(server.stats());
+	}
+
+	server.stop();
+	server_thread.join();
+	print_stats(server.stats());
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "sparse_net.hpp"
+
+#include <cassert>
+#include <algorithm>
+
+namespace NN
+{
+
+SparseNet::SparseNet(const DenseNet &network)
+{
+	for(const auto &dense_layer: network.layers())
+	{
+		SparseLayer sparse;
+		sparse.layer = dense_layer.layer;
+		sparse.input_size = dense_layer.input_size;
+		sparse.output_size = dense_layer.output_size;
+
+		const double *weights = network.parameters().data() + dense_layer.weights_offset;
+		const double *biases = network.parameters().data() + dense_layer.biases_offset;
+
+		switch(dense_layer.layer.operation)
+		{
+		case Layer::Func::LINEAR:
+			sparse.sparse_weights = CsrMatrix::from_dense(weights, sparse.output_size, sparse.input_size);
+			sparse.biases.assign(biases, biases + sparse.output_size);
+			break;
+		case Layer::Func::CONV2D:
+			sparse.weights.assign(weights, biases);
+			sparse.biases.assign(biases, biases + dense_layer.layer.out_channels);
+			break;
+		default:
+			break;
+		}
+
+		m_layers.push_back(std::move(sparse));
+	}
+}
+
+std::vector<double> SparseNet::forward(const double *inputs, size_t batch_size) const
+{
+	std::vector<double> current(inputs, inputs + batch_size * m_layers.front().input_size);
+	std::vector<double> next;
+	std::vector<uint32_t> argmax;
+
+	for(const auto &layer: m_layers)
+	{
+		const size_t in_size = layer.input_size;
+		const size_t out_size = layer.output_size;
+		next.resize(batch_size * out_size);
+
+		switch(layer.layer.operation)
+		{
+		case Layer::Func::LINEAR:
+			csr_linear_forward(batch_size, layer.sparse_weights, layer.biases.data(), current.data(), next.data());
+			break;
+		case Layer::Func::CONV2D:
+			for(size_t s = 0; s < batch_size; ++s)
+				conv2d_forward(layer.layer, layer.weights.data(), layer.biases.data(), current.data() + s * in_size, next.data() + s * out_size);
+			break;
+		case Layer::Func::MAXPOOL2D:
+			argmax.resize(out_size);
+			for(size_t s = 0; s < batch_size; ++s)
+				maxpool2d_forward(layer.layer, current.data() + s * in_size, next.data() + s * out_size, argmax.data());
+			break;
+		case Layer::Func::RELU:
+			for(size_t i = 0; i < next.size(); ++i)
+				next[i] = current[i] > 0.0 ? current[i]: 0.0;
+			break;
+		case Layer::Func::SOFTMAX:
+			for(size_t s = 0; s < batch_size; ++s)
+				softmax_forward(current.data() + s * in_size, in_size, next.data() + s * out_size);
+			break;
+		default:
+			assert(false);
+			break;
+		}
+
+		std::swap(current, next);
+	}
+
+	return current;
+}
+
+size_t SparseNet::parameter_bytes() const
+{
+	size_t bytes = 0;
+	for(const auto &layer: m_layers)
+		bytes += layer.sparse_weights.bytes() + (layer.weights.size() + layer.biases.size()) * sizeof(double);
+
+	return bytes;
+}
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "dense_net.hpp"
+#include "kernels.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+/**
+ * @brief Inference-only copy of a pruned DenseNet: the weights of the LINEAR layers are stored in CSR format
+ * without their zeros and evaluated with csr_linear_forward, so that the memory and the time spent in these
+ * layers are proportional to the number of weights left. The other layers are evaluated as in DenseNet
+ * 
+ */
+class SparseNet
+{
+public:
+	/**
+	 * @brief Copies the parameters of network, the zero weights of its LINEAR layers are dropped
+	 * 
+	 * @param network 
+	 */
+	SparseNet(const DenseNet &network);
+
+	/**
+	 * @brief Output of the network for a batch of inputs
+	 * 
+	 * @param inputs batch_size x input_size, row-major
+	 * @param batch_size 
+	 * @return std::vector<double> batch_size x output_size, row-major
+	 */
+	std::vector<double> forward(const double *inputs, size_t batch_size) const;
+
+	// Memory used by the parameters, in bytes
+	size_t parameter_bytes() const;
+
+private:
+	struct SparseLayer
+	{
+		Layer layer;
+		size_t input_size;
+		size_t output_size;
+
+		// LINEAR only
+		CsrMatrix sparse_weights;
+
+		// CONV2D only
+		std::vector<double> weights;
+
+		std::vector<double> biases;
+	};
+
+	std::vector<SparseLayer> m_layers;
+};
+
+} // namespace NN
\ No newline at end of file
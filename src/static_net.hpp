@@ -0,0 +1,275 @@
+#pragma once
+
+#include "neural_network.hpp"
+
+#include <array>
+#include <tuple>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+namespace NN
+{
+
+// Layers of a StaticNet, each one provides an Impl<InputSize> holding its parameters and forward pass
+
+template<int In, int Out>
+struct Linear
+{
+	static_assert(In > 0 && Out > 0, "Linear layer sizes must be positive");
+	static constexpr int input_size = In;
+
+	template<int InputSize>
+	struct Impl
+	{
+		static_assert(InputSize == In, "Linear layer input size doesn't match the previous layer's output size");
+		static constexpr int output_size = Out;
+
+		static Layer description() { return linear(In, Out); }
+
+		void forward(const std::array<double, In> &x, std::array<double, Out> &y) const
+		{
+			for(int o = 0; o < Out; ++o)
+			{
+				double sum = biases[o];
+				for(int i = 0; i < In; ++i)
+					sum += weights[o * In + i] * x[i];
+				y[o] = sum;
+			}
+		}
+
+		void load(const LayerParameters &parameters)
+		{
+			for(int i = 0; i < Out * In; ++i)
+				weights[i] = parameters.weights[i]->value();
+			for(int i = 0; i < Out; ++i)
+				biases[i] = parameters.biases[i]->value();
+		}
+
+		void store(const LayerParameters &parameters) const
+		{
+			for(int i = 0; i < Out * In; ++i)
+				parameters.weights[i]->m_value = weights[i];
+			for(int i = 0; i < Out; ++i)
+				parameters.biases[i]->m_value = biases[i];
+		}
+
+		// Same layout as LayerParameters
+		std::array<double, Out * In> weights {};
+		std::array<double, Out> biases {};
+	};
+};
+
+struct ReLU
+{
+	template<int InputSize>
+	struct Impl
+	{
+		static constexpr int output_size = InputSize;
+
+		static Layer description() { return relu(); }
+
+		void forward(const std::array<double, InputSize> &x, std::array<double, InputSize> &y) const
+		{
+			for(int i = 0; i < InputSize; ++i)
+				y[i] = x[i] > 0.0 ? x[i]: 0.0;
+		}
+
+		void load(const LayerParameters &) {}
+		void store(const LayerParameters &) const {}
+	};
+};
+
+struct Softmax
+{
+	template<int InputSize>
+	struct Impl
+	{
+		static constexpr int output_size = InputSize;
+
+		static Layer description() { return softmax(); }
+
+		void forward(const std::array<double, InputSize> &x, std::array<double, InputSize> &y) const
+		{
+			double max_x = x[0];
+			for(int i = 1; i < InputSize; ++i)
+				max_x = x[i] > max_x ? x[i]: max_x;
+
+			double exp_total = 0.0;
+			for(int i = 0; i < InputSize; ++i)
+			{
+				y[i] = std::exp(x[i] - max_x);
+				exp_total += y[i];
+			}
+
+			for(int i = 0; i < InputSize; ++i)
+				y[i] /= exp_total;
+		}
+
+		void load(const LayerParameters &) {}
+		void store(const LayerParameters &) const {}
+	};
+};
+
+namespace detail
+{
+
+// Instantiates each layer with the output size of the previous one
+template<int InputSize, typename... Layers>
+struct Chain
+{
+	using type = std::tuple<>;
+	static constexpr int output_size = InputSize;
+};
+
+template<int InputSize, typename First, typename... Rest>
+struct Chain<InputSize, First, Rest...>
+{
+	using impl = typename First::template Impl<InputSize>;
+	using rest = Chain<impl::output_size, Rest...>;
+
+	using type = decltype(std::tuple_cat(std::declval<std::tuple<impl>>(), std::declval<typename rest::type>()));
+	static constexpr int output_size = rest::output_size;
+};
+
+} // namespace detail
+
+/**
+ * @brief Network whose architecture is fixed at compile time, ex: StaticNet<Linear<784, 16>, ReLU, Linear<16, 10>, Softmax>.
+ * Shape mismatches are compile errors, the parameters are std::array members and forward only uses stack buffers
+ * with constant loop bounds. It reads and writes the same weight files as NeuralNet
+ * 
+ * @tparam First Must be a Linear layer, which gives the input size
+ * @tparam Rest 
+ */
+template<typename First, typename... Rest>
+class StaticNet
+{
+	using Chain = detail::Chain<First::input_size, First, Rest...>;
+
+public:
+	static constexpr int input_size = First::input_size;
+	static constexpr int output_size = Chain::output_size;
+	static constexpr size_t layer_count = sizeof...(Rest) + 1;
+
+	using Input = std::array<double, input_size>;
+	using Output = std::array<double, output_size>;
+
+	StaticNet() = default;
+
+	/**
+	 * @brief Output of the network
+	 * 
+	 * @param input 
+	 * @return Output 
+	 */
+	Output forward(const Input &input) const
+	{
+		return forward_from<0>(input);
+	}
+
+	// The architecture, as given to NeuralNet
+	static std::vector<Layer> architecture()
+	{
+		return architecture(std::make_index_sequence<layer_count>());
+	}
+
+	/**
+	 * @brief Copies the parameters of network
+	 * 
+	 * @param network 
+	 * @return false if its architecture is different
+	 */
+	bool load(const NeuralNet &network)
+	{
+		if(!same_architecture(network.architecture()))
+			return false;
+
+		load(network, std::make_index_sequence<layer_count>());
+		return true;
+	}
+
+	/**
+	 * @brief Copies the parameters into network
+	 * 
+	 * @param network 
+	 * @return false if its architecture is different
+	 */
+	bool store(NeuralNet &network) const
+	{
+		if(!same_architecture(network.architecture()))
+			return false;
+
+		store(network, std::make_index_sequence<layer_count>());
+		return true;
+	}
+
+	bool load_weights(const std::string &path)
+	{
+		NeuralNet network;
+		return network.load_weights(path) && load(network);
+	}
+
+	bool save_weights(const std::string &path) const
+	{
+		NeuralNet network(architecture());
+		return store(network) && network.save_weights(path);
+	}
+
+private:
+	template<size_t I, size_t N>
+	auto forward_from(const std::array<double, N> &x) const
+	{
+		if constexpr(I == layer_count)
+		{
+			return x;
+		}
+		else
+		{
+			const auto &layer = std::get<I>(m_layers);
+			std::array<double, std::tuple_element_t<I, typename Chain::type>::output_size> y;
+			layer.forward(x, y);
+			return forward_from<I+1>(y);
+		}
+	}
+
+	template<size_t... I>
+	static std::vector<Layer> architecture(std::index_sequence<I...>)
+	{
+		return { std::tuple_element_t<I, typename Chain::type>::description()... };
+	}
+
+	static bool same_architecture(const std::vector<Layer> &other)
+	{
+		auto layers = architecture();
+		if(layers.size() != other.size())
+			return false;
+
+		for(size_t i = 0; i < layers.size(); ++i)
+		{
+			if(layers[i].operation != other[i].operation || layers[i].input_size != other[i].input_size ||
+				layers[i].output_size != other[i].output_size)
+				return false;
+		}
+
+		return true;
+	}
+
+	template<size_t... I>
+	void load(const NeuralNet &network, std::index_sequence<I...>)
+	{
+		(std::get<I>(m_layers).load(network.parameters()[I]), ...);
+	}
+
+	template<size_t... I>
+	void store(NeuralNet &network, std::index_sequence<I...>) const
+	{
+		(std::get<I>(m_layers).store(network.parameters()[I]), ...);
+	}
+
+	typename Chain::type m_layers;
+};
+
+} // namespace NN
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "sweep.hpp"
+#include "optimizer.hpp"
+#include "dense_net.hpp"
+#include "dataset.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <cassert>
+
+namespace NN
+{
+
+std::vector<SweepConfig> grid_search(const SweepSpace &space)
+{
+	std::vector<SweepConfig> configs;
+
+	for(auto learning_rate: space.learning_rates)
+	for(auto momentum: space.momentums)
+	for(const auto &hidden_layers: space.hidden_layers)
+	for(auto batch_size: space.batch_sizes)
+	{
+		SweepConfig config;
+		config.learning_rate = learning_rate;
+		config.momentum = momentum;
+		config.hidden_layers = hidden_layers;
+		config.batch_size = batch_size;
+
+		configs.push_back(config);
+	}
+
+	return configs;
+}
+
+std::vector<SweepConfig> random_search(const SweepSpace &space, size_t count, uint32_t seed)
+{
+	assert(!space.learning_rates.empty() && !space.momentums.empty());
+	assert(!space.hidden_layers.empty() && !space.batch_sizes.empty());
+
+	auto [min_rate, max_rate] = std::minmax_element(space.learning_rates.begin(), space.learning_rates.end());
+	auto [min_momentum, max_momentum] = std::minmax_element(space.momentums.begin(), space.momentums.end());
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> log_rate(std::log(*min_rate), std::log(*max_rate));
+	std::uniform_real_distribution<double> momentum(*min_momentum, *max_momentum);
+	std::uniform_int_distribution<size_t> hidden_layers(0, space.hidden_layers.size() - 1);
+	std::uniform_int_distribution<size_t> batch_size(0, space.batch_sizes.size() - 1);
+
+	std::vector<SweepConfig> configs(count);
+	for(auto &config: configs)
+	{
+		config.learning_rate = std::exp(log_rate(rng));
+		config.momentum = momentum(rng);
+		config.hidden_layers = space.hidden_layers[hidden_layers(rng)];
+		config.batch_size = space.batch_sizes[batch_size(rng)];
+	}
+
+	return configs;
+}
+
+std::vector<Layer> sweep_architecture(const SweepConfig &config, int input_size, int output_size)
+{
+	std::vector<Layer> architecture;
+
+	for(auto width: config.hidden_layers)
+	{
+		architecture.push_back(linear(input_size, width));
+		architecture.push_back(relu());
+		input_size = width;
+	}
+
+	architecture.push_back(linear(input_size, output_size));
+	architecture.push_back(softmax());
+
+	return architecture;
+}
+
+static std::string describe(const SweepConfig &config)
+{
+	std::ostringstream out;
+	out << "lr=" << config.learning_rate << " momentum=" << config.momentum << " hidden=";
+
+	for(size_t i = 0; i < config.hidden_layers.size(); ++i)
+		out << (i ? "x": "") << config.hidden_layers[i];
+
+	out << " batch=" << config.batch_size;
+	return out.str();
+}
+
+static SweepResult train_config(
+	const SweepConfig &config,
+	const std::vector<std::vector<double>> &X_train,
+	const std::vector<uint32_t> &y_train,
+	const std::vector<uint32_t> &permutation,
+	const std::vector<double> &test_inputs,
+	const std::vector<uint32_t> &y_test,
+	const SweepSettings &settings
+)
+{
+	const int output_size = *std::max_element(y_train.begin(), y_train.end()) + 1;
+
+	SweepResult result;
+	result.config = config;
+
+	auto start = std::chrono::steady_clock::now();
+
+	NeuralNet neural_net(sweep_architecture(config, X_train[0].size(), output_size));
+	Optimizer optimizer(neural_net, config.learning_rate, config.momentum);
+
+	for(int step = 0; step < settings.steps; ++step)
+	{
+		optimizer.zero_grad();
+
+		for(int i = 0; i < config.batch_size; ++i)
+		{
+			size_t index = permutation[(static_cast<size_t>(step) * config.batch_size + i) % X_train.size()];
+			optimizer.accumulate(X_train[index], y_train[index]);
+		}
+
+		optimizer.step();
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Scored in one batch through the dense kernels
+	const size_t test_size = y_test.size();
+	auto outputs = DenseNet(neural_net).forward(test_inputs.data(), test_size);
+
+	double correct_guess = 0.0;
+	for(size_t i = 0; i < test_size; ++i)
+	{
+		auto first = outputs.begin() + i * output_size;
+		if(std::max_element(first, first + output_size) - first == y_test[i])
+			correct_guess += 1.0;
+
+		result.test_loss -= std::log(first[y_test[i]] + CG::cross_entropy_epsilon);
+	}
+
+	result.test_loss /= (double)test_size;
+	result.test_accuracy = correct_guess / (double)test_size;
+
+	return result;
+}
+
+std::vector<SweepResult> run_sweep(
+	const std::vector<SweepConfig> &configs,
+	const std::vector<std::vector<double>> &X_train,
+	const std::vector<uint32_t> &y_train,
+	const std::vector<std::vector<double>> &X_test,
+	const std::vector<uint32_t> &y_test,
+	const SweepSettings &settings
+)
+{
+	assert(!X_train.empty() && X_train.size() == y_train.size());
+	assert(!X_test.empty() && X_test.size() == y_test.size());
+
+	// Read only from here on, shared by every run
+	const auto permutation = generate_permutation(X_train.size());
+	const size_t test_size = std::min(settings.test_size, X_test.size());
+	const auto test_inputs = flatten_samples(X_test, 0, test_size);
+	const std::vector<uint32_t> test_labels(y_test.begin(), y_test.begin() + test_size);
+
+	unsigned thread_count = settings.thread_count;
+	if(thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	thread_count = std::min<size_t>(thread_count, configs.size());
+
+	std::vector<SweepResult> results(configs.size());
+	std::atomic<size_t> next_config {0};
+	size_t finished = 0;
+	std::mutex print_mutex;
+
+	// The runs don't take the same time, so each thread picks the next one when it is done with its own
+	auto worker = [&]() {
+		for(size_t i = next_config++; i < configs.size(); i = next_config++)
+		{
+			results[i] = train_config(configs[i], X_train, y_train, permutation, test_inputs, test_labels, settings);
+
+			std::lock_guard<std::mutex> lock(print_mutex);
+			std::cout << "[" << ++finished << "/" << configs.size() << "] " << describe(configs[i])
+				<< " -> " << results[i].test_accuracy * 100 << "%" << std::endl;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for(unsigned i = 1; i < thread_count; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for(auto &thread: threads)
+		thread.join();
+
+	// Diverged runs can have a nan loss, which compares false with everything: they are ordered after the others explicitly
+	std::stable_sort(results.begin(), results.end(), [](const SweepResult &a, const SweepResult &b) {
+		if(a.test_accuracy != b.test_accuracy)
+			return a.test_accuracy > b.test_accuracy;
+		if(std::isnan(a.test_loss) != std::isnan(b.test_loss))
+			return !std::isnan(a.test_loss);
+		return a.test_loss < b.test_loss;
+	});
+
+	return results;
+}
+
+void print_sweep_results(const std::vector<SweepResult> &results, std::ostream &out)
+{
+	out << std::left << std::setw(6) << "Rank" << std::setw(12) << "Accuracy" << std::setw(12) << "Loss"
+		<< std::setw(10) << "Time" << "Configuration" << std::endl;
+
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		const auto &result = results[i];
+		std::ostringstream accuracy;
+		accuracy << std::fixed << std::setprecision(2) << result.test_accuracy * 100 << "%";
+
+		out << std::left << std::setw(6) << i+1 << std::setw(12) << accuracy.str()
+			<< std::setw(12) << result.test_loss << std::setw(10) << result.seconds
+			<< describe(result.config) << std::endl;
+	}
+}
+
+} // namespace NN
\ No newline at end of file
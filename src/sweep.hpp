@@ -0,0 +1,102 @@
+#pragma once
+
+#include "neural_network.hpp"
+
+#include <vector>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+namespace NN
+{
+
+/**
+ * @brief Hyperparameters of one training run of a sweep
+ *
+ */
+struct SweepConfig
+{
+	double learning_rate = 1.0;
+	double momentum = 0.9;
+
+	// Width of each hidden layer, each one is followed by a relu
+	std::vector<int> hidden_layers {16};
+
+	int batch_size = 32;
+};
+
+/**
+ * @brief Values tried by a sweep. A grid search tries every combination, a random search draws the learning rate
+ * log-uniformly and the momentum uniformly between the smallest and largest listed values, and picks the others from the lists
+ *
+ */
+struct SweepSpace
+{
+	std::vector<double> learning_rates {0.1, 0.5, 1.0};
+	std::vector<double> momentums {0.0, 0.9};
+	std::vector<std::vector<int>> hidden_layers {{16}, {32}};
+	std::vector<int> batch_sizes {32};
+};
+
+struct SweepSettings
+{
+	// Optimizer steps of each run
+	int steps = 200;
+
+	// Number of test samples used to score each run
+	size_t test_size = 1000;
+
+	// 0 means std::thread::hardware_concurrency()
+	unsigned thread_count = 0;
+};
+
+struct SweepResult
+{
+	SweepConfig config;
+	double test_loss = 0.0;
+	double test_accuracy = 0.0;
+
+	// Training time of the run
+	double seconds = 0.0;
+};
+
+// Every combination of the values of space
+std::vector<SweepConfig> grid_search(const SweepSpace &space);
+
+std::vector<SweepConfig> random_search(const SweepSpace &space, size_t count, uint32_t seed = 0);
+
+/**
+ * @brief The network trained by a run: linear layers of the given widths with relus between them, followed by a softmax
+ *
+ * @param config
+ * @param input_size
+ * @param output_size
+ * @return std::vector<Layer>
+ */
+std::vector<Layer> sweep_architecture(const SweepConfig &config, int input_size, int output_size);
+
+/**
+ * @brief Trains one network per configuration like train_and_save_nn does, several at a time on a pool of threads.
+ * Every run reads the same samples in the same order, the dataset is shared and never copied
+ *
+ * @param configs
+ * @param X_train
+ * @param y_train
+ * @param X_test
+ * @param y_test
+ * @param settings
+ * @return std::vector<SweepResult> Sorted from the best test accuracy to the worst
+ */
+std::vector<SweepResult> run_sweep(
+	const std::vector<SweepConfig> &configs,
+	const std::vector<std::vector<double>> &X_train,
+	const std::vector<uint32_t> &y_train,
+	const std::vector<std::vector<double>> &X_test,
+	const std::vector<uint32_t> &y_test,
+	const SweepSettings &settings = SweepSettings()
+);
+
+// Prints the results as a table, one run per line
+void print_sweep_results(const std::vector<SweepResult> &results, std::ostream &out);
+
+} // namespace NN
\ No newline at end of file
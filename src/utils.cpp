@@ -1,5 +1,8 @@
 #include "utils.hpp"
 #include <random>
+#include <thread>
+#include <algorithm>
+#include <atomic>
 
 void dfs(
 	const CG::Value& node,
@@ -18,26 +21,48 @@ void dfs(
 }
 
 
+// Every call of topological_sort is a new traversal
+static std::atomic<uint64_t> last_traversal {0};
+
 std::vector<CG::Value> topological_sort(const std::vector<CG::Value> &initial_nodes)
 {
-	std::unordered_set<CG::Value> visited;
-	std::stack<CG::Value> order;
+	// Same order as dfs, without recursion nor hash set: the nodes reached are marked with the traversal,
+	// and each entry of the path is a node with its next child to visit
+	const uint64_t traversal = ++last_traversal;
+	std::vector<std::pair<const CG::Value*, size_t>> path;
+	std::vector<CG::Value> sorted_order;
 
 	for (const auto& node : initial_nodes)
 	{
-		if (visited.find(node) == visited.end())
+		if (node->m_traversal == traversal)
+			continue;
+
+		node->m_traversal = traversal;
+		path.emplace_back(&node, 0);
+
+		while (!path.empty())
 		{
-			dfs(node, visited, order);
-		}
-	}
+			auto &[current, next_child] = path.back();
+			const auto &children = (*current)->m_children;
 
-	std::vector<CG::Value> sorted_order;
-	while (!order.empty())
-	{
-		sorted_order.push_back(order.top());
-		order.pop();
+			if (next_child < children.size())
+			{
+				const auto &child = children[next_child++];
+				if (child->m_traversal != traversal)
+				{
+					child->m_traversal = traversal;
+					path.emplace_back(&child, 0);
+				}
+				continue;
+			}
+
+			(*current)->m_post_order = sorted_order.size();
+			sorted_order.push_back(*current);
+			path.pop_back();
+		}
 	}
 
+	std::reverse(sorted_order.begin(), sorted_order.end());
 	return sorted_order;
 }
 
@@ -65,3 +90,33 @@ std::vector<uint32_t> generate_permutation(uint32_t size)
 
 	return output;
 }
+
+
+void parallel_for(size_t count, const std::function<void(size_t, size_t)> &func, unsigned thread_count)
+{
+	if(thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	size_t chunk_count = std::min<size_t>(thread_count, count);
+	if(chunk_count <= 1)
+	{
+		if(count > 0)
+			func(0, count);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(chunk_count - 1);
+
+	size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+	for(size_t begin = chunk_size; begin < count; begin += chunk_size)
+	{
+		threads.emplace_back(func, begin, std::min(begin + chunk_size, count));
+	}
+
+	// The calling thread takes the first chunk
+	func(0, std::min(chunk_size, count));
+
+	for(auto &thread: threads)
+		thread.join();
+}
\ No newline at end of file
@@ -6,12 +6,30 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <functional>
 
 void dfs(
 	const CG::Value& node,
 	std::unordered_set<CG::Value>& visited,
 	std::stack<CG::Value>& order );
 
+/**
+ * @brief Orders the nodes reachable from initial_nodes so that every node comes before its children
+ * (same order as dfs). Writes the scratch fields of the nodes: the sorts of two graphs sharing nodes can't run concurrently
+ * 
+ * @param initial_nodes 
+ * @return std::vector<CG::Value> 
+ */
 std::vector<CG::Value> topological_sort(const std::vector<CG::Value> &initial_nodes);
 
-std::vector<uint32_t> generate_permutation(uint32_t size);
\ No newline at end of file
+std::vector<uint32_t> generate_permutation(uint32_t size);
+
+/**
+ * @brief Splits [0, count) into contiguous chunks and runs func(begin, end) on each of them from a different thread
+ * 
+ * @param count 
+ * @param func Called once per chunk, must be safe to call concurrently on disjoint ranges
+ * @param thread_count 0 means std::thread::hardware_concurrency()
+ */
+void parallel_for(size_t count, const std::function<void(size_t, size_t)> &func, unsigned thread_count = 0);
\ No newline at end of file